@@ -0,0 +1,367 @@
+#ifndef COMPONENTS_H
+#define COMPONENTS_H
+
+#include <vector>
+using std::vector;
+
+#include <cstddef>
+
+#include "primitives.h"
+#include "marching_squares.h"
+
+
+// Per-component statistics.
+class component_stats
+{
+public:
+	double area;
+	double length;
+	double x_min;
+	double x_max;
+	double y_min;
+	double y_max;
+	size_t num_line_segments;
+	size_t num_triangles;
+};
+
+// Labels the connected components of the image area (pixels at or above the isovalue,
+// 4-connected) one pixel row at a time, using union-find, and attributes each triangle
+// and line segment to the component of the inside corner it belongs to. The saddle cases
+// (5 and 10) keep their two inside corners apart, which is exactly 4-connectivity.
+//
+// A component's geometry is held back until its area reaches min_area; from then on it
+// goes straight to the output. A component is finished once a completed row of grid
+// squares no longer reaches it; if its area is still below min_area, its held-back
+// geometry is dropped, otherwise its statistics are added to components.
+// Labels are recycled once their row has been passed, so memory stays proportional
+// to the image width plus the geometry of the components still below min_area.
+class component_labeler
+{
+public:
+	vector<component_stats> components;
+	size_t num_dropped;
+
+	component_labeler(const double src_min_area = 0)
+	{
+		min_area = src_min_area;
+		num_dropped = 0;
+		num_rows = 0;
+	}
+
+	// Label the next pixel row. The march over grid square row y needs pixel rows y and y + 1.
+	void label_row(const float *const row, const unsigned short int px, const double isovalue)
+	{
+		top_labels.swap(bottom_labels);
+		bottom_labels.resize(px);
+
+		for(size_t x = 0; x < px; x++)
+		{
+			if(row[x] < isovalue)
+			{
+				bottom_labels[x] = no_label;
+				continue;
+			}
+
+			size_t label = no_label;
+
+			if(0 != x && no_label != bottom_labels[x - 1])
+				label = bottom_labels[x - 1];
+
+			if(0 != num_rows && no_label != top_labels[x])
+			{
+				if(no_label == label)
+					label = top_labels[x];
+				else
+					unite(label, top_labels[x]);
+			}
+
+			if(no_label == label)
+				label = new_label();
+
+			bottom_labels[x] = label;
+		}
+
+		num_rows++;
+	}
+
+	// Attribute the geometry that grid square x of the current row generated
+	// for case index mask (in table order) to its components.
+	void add(const unsigned short int x, const unsigned short int mask, const line_segment *const line_segments, const triangle *const cell_triangles, vector<line_segment> &out_line_segments, vector<triangle> &out_triangles)
+	{
+		const marching_squares_case &c = marching_squares_cases[mask];
+
+		for(size_t i = 0; i < c.num_triangles; i++)
+		{
+			// Every triangle has at least one inside corner.
+			unsigned char corner = c.triangles[i][0];
+
+			if(corner > 3)
+				corner = (c.triangles[i][1] < 4) ? c.triangles[i][1] : c.triangles[i][2];
+
+			component &k = components_data[find(corner_label(x, corner))];
+			triangle t = cell_triangles[i];
+
+			k.stats.area += t.area();
+			k.stats.num_triangles++;
+
+			for(size_t j = 0; j < 3; j++)
+				grow_bounds(k.stats, t.vertex[j]);
+
+			if(true == k.kept)
+				out_triangles.push_back(t);
+			else
+				k.pending_triangles.push_back(t);
+
+			keep_if_large(k, out_line_segments, out_triangles);
+		}
+
+		for(size_t i = 0; i < c.num_line_segments; i++)
+		{
+			// The inside corner of the edge that the line segment starts on.
+			const unsigned char edge = c.line_segments[i][0] - 4;
+			const unsigned char corner = ((mask >> edge) & 1) ? edge : (edge + 1) % 4;
+
+			component &k = components_data[find(corner_label(x, corner))];
+			line_segment ls = line_segments[i];
+
+			k.stats.length += ls.length();
+			k.stats.num_line_segments++;
+
+			if(true == k.kept)
+				out_line_segments.push_back(ls);
+			else
+				k.pending_line_segments.push_back(ls);
+		}
+	}
+
+	// Call once a row of grid squares is complete. Components that the bottom pixel
+	// row no longer reaches are finished.
+	void end_row(vector<line_segment> &out_line_segments, vector<triangle> &out_triangles)
+	{
+		// Point every bottom row label directly at its root, and mark the live roots.
+		for(size_t x = 0; x < bottom_labels.size(); x++)
+		{
+			if(no_label == bottom_labels[x])
+				continue;
+
+			bottom_labels[x] = find(bottom_labels[x]);
+			components_data[bottom_labels[x]].live_row = num_rows;
+		}
+
+		vector<size_t> still_active;
+
+		for(size_t i = 0; i < active_labels.size(); i++)
+		{
+			size_t label = active_labels[i];
+			component &k = components_data[label];
+
+			if(label != parent[label])
+			{
+				// Merged into another component.
+				free_label(label);
+			}
+			else if(num_rows == k.live_row)
+			{
+				still_active.push_back(label);
+			}
+			else
+			{
+				finish(label, out_line_segments, out_triangles);
+			}
+		}
+
+		active_labels.swap(still_active);
+	}
+
+	// Finish all remaining components.
+	void flush(vector<line_segment> &out_line_segments, vector<triangle> &out_triangles)
+	{
+		for(size_t i = 0; i < active_labels.size(); i++)
+		{
+			size_t label = active_labels[i];
+
+			if(label == parent[label])
+				finish(label, out_line_segments, out_triangles);
+		}
+
+		active_labels.clear();
+	}
+
+private:
+	static const size_t no_label = static_cast<size_t>(-1);
+
+	class component
+	{
+	public:
+		component_stats stats;
+		bool kept;
+		size_t live_row;
+		vector<line_segment> pending_line_segments;
+		vector<triangle> pending_triangles;
+	};
+
+	double min_area;
+	size_t num_rows;
+
+	vector<size_t> top_labels;
+	vector<size_t> bottom_labels;
+
+	vector<size_t> parent;
+	vector<component> components_data;
+	vector<size_t> free_labels;
+	vector<size_t> active_labels; // Every label in use, root or not.
+
+	size_t new_label(void)
+	{
+		size_t label;
+
+		if(0 != free_labels.size())
+		{
+			label = free_labels.back();
+			free_labels.pop_back();
+		}
+		else
+		{
+			label = parent.size();
+			parent.push_back(label);
+			components_data.push_back(component());
+		}
+
+		parent[label] = label;
+
+		component &k = components_data[label];
+		k.stats.area = 0;
+		k.stats.length = 0;
+		k.stats.x_min = k.stats.y_min = 1e300;
+		k.stats.x_max = k.stats.y_max = -1e300;
+		k.stats.num_line_segments = 0;
+		k.stats.num_triangles = 0;
+		k.kept = (0 == min_area);
+		k.live_row = 0;
+		k.pending_line_segments.clear();
+		k.pending_triangles.clear();
+
+		active_labels.push_back(label);
+
+		return label;
+	}
+
+	void free_label(const size_t label)
+	{
+		vector<line_segment>().swap(components_data[label].pending_line_segments);
+		vector<triangle>().swap(components_data[label].pending_triangles);
+		free_labels.push_back(label);
+	}
+
+	size_t find(size_t label)
+	{
+		size_t root = label;
+
+		while(parent[root] != root)
+			root = parent[root];
+
+		// Path compression.
+		while(parent[label] != root)
+		{
+			size_t next = parent[label];
+			parent[label] = root;
+			label = next;
+		}
+
+		return root;
+	}
+
+	void unite(const size_t a, const size_t b)
+	{
+		size_t ra = find(a);
+		size_t rb = find(b);
+
+		if(ra == rb)
+			return;
+
+		component &ka = components_data[ra];
+		component &kb = components_data[rb];
+
+		// Keep the larger pending geometry in place.
+		if(ka.pending_triangles.size() < kb.pending_triangles.size())
+		{
+			ka.pending_triangles.swap(kb.pending_triangles);
+			ka.pending_line_segments.swap(kb.pending_line_segments);
+		}
+
+		ka.pending_triangles.insert(ka.pending_triangles.end(), kb.pending_triangles.begin(), kb.pending_triangles.end());
+		ka.pending_line_segments.insert(ka.pending_line_segments.end(), kb.pending_line_segments.begin(), kb.pending_line_segments.end());
+		kb.pending_triangles.clear();
+		kb.pending_line_segments.clear();
+
+		ka.stats.area += kb.stats.area;
+		ka.stats.length += kb.stats.length;
+		ka.stats.num_triangles += kb.stats.num_triangles;
+		ka.stats.num_line_segments += kb.stats.num_line_segments;
+
+		if(kb.stats.x_min < ka.stats.x_min) ka.stats.x_min = kb.stats.x_min;
+		if(kb.stats.x_max > ka.stats.x_max) ka.stats.x_max = kb.stats.x_max;
+		if(kb.stats.y_min < ka.stats.y_min) ka.stats.y_min = kb.stats.y_min;
+		if(kb.stats.y_max > ka.stats.y_max) ka.stats.y_max = kb.stats.y_max;
+
+		// If either part has already been written out, the rest follows
+		// at its next triangle, or when it is finished.
+		ka.kept = ka.kept || kb.kept;
+
+		parent[rb] = ra;
+	}
+
+	inline size_t corner_label(const unsigned short int x, const unsigned char corner) const
+	{
+		// Corner vertex order: 03
+		//                      12
+		switch(corner)
+		{
+			case 0: return top_labels[x];
+			case 1: return bottom_labels[x];
+			case 2: return bottom_labels[x + 1];
+			default: return top_labels[x + 1];
+		}
+	}
+
+	inline void grow_bounds(component_stats &s, const vertex_2 &v)
+	{
+		if(v.x < s.x_min) s.x_min = v.x;
+		if(v.x > s.x_max) s.x_max = v.x;
+		if(v.y < s.y_min) s.y_min = v.y;
+		if(v.y > s.y_max) s.y_max = v.y;
+	}
+
+	void keep_if_large(component &k, vector<line_segment> &out_line_segments, vector<triangle> &out_triangles)
+	{
+		if(false == k.kept && k.stats.area < min_area)
+			return;
+
+		k.kept = true;
+
+		if(0 == k.pending_triangles.size() && 0 == k.pending_line_segments.size())
+			return;
+
+		out_triangles.insert(out_triangles.end(), k.pending_triangles.begin(), k.pending_triangles.end());
+		out_line_segments.insert(out_line_segments.end(), k.pending_line_segments.begin(), k.pending_line_segments.end());
+
+		k.pending_triangles.clear();
+		k.pending_line_segments.clear();
+	}
+
+	void finish(const size_t label, vector<line_segment> &out_line_segments, vector<triangle> &out_triangles)
+	{
+		component &k = components_data[label];
+
+		keep_if_large(k, out_line_segments, out_triangles);
+
+		if(true == k.kept)
+			components.push_back(k.stats);
+		else
+			num_dropped++;
+
+		free_label(label);
+	}
+};
+
+#endif
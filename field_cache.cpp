@@ -0,0 +1,348 @@
+#include "field_cache.h"
+
+#include <fstream>
+using std::ofstream;
+
+#include <sstream>
+using std::ostringstream;
+
+#include <cstdio>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const char field_cache_magic[8] = { 'M', 'S', 'F', 'I', 'E', 'L', 'D', '\0' };
+static const unsigned int field_cache_version = 3;
+
+static unsigned long long align_offset(const unsigned long long offset)
+{
+	return (offset + field_cache_alignment - 1)/field_cache_alignment*field_cache_alignment;
+}
+
+static void write_padding(ofstream &out, const unsigned long long from, const unsigned long long to)
+{
+	for(unsigned long long i = from; i < to; i++)
+		out.put('\0');
+}
+
+field_cache::field_cache(void)
+{
+	px = 0;
+	py = 0;
+	pixels = 0;
+	data = 0;
+	data_size = 0;
+}
+
+field_cache::~field_cache(void)
+{
+	release();
+}
+
+void field_cache::release(void)
+{
+#ifndef _WIN32
+	if(0 != data && 0 == read_data.size())
+		munmap(const_cast<unsigned char *>(data), data_size);
+#endif
+
+	vector<unsigned char>().swap(read_data);
+
+	data = 0;
+	data_size = 0;
+	pixels = 0;
+	px = 0;
+	py = 0;
+}
+
+string field_cache::cache_filename(const char *const filename)
+{
+	return string(filename) + ".field";
+}
+
+bool field_cache::source_key(const char *const filename, unsigned long long &size, long long &mtime)
+{
+	struct stat s;
+
+	if(0 != stat(filename, &s))
+		return false;
+
+	size = static_cast<unsigned long long>(s.st_size);
+
+	// In nanoseconds where the platform has them, so that an image rewritten within the same second is noticed.
+#if defined(__APPLE__)
+	mtime = static_cast<long long>(s.st_mtimespec.tv_sec)*1000000000 + s.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+	mtime = static_cast<long long>(s.st_mtime)*1000000000;
+#else
+	mtime = static_cast<long long>(s.st_mtim.tv_sec)*1000000000 + s.st_mtim.tv_nsec;
+#endif
+
+	return true;
+}
+
+unsigned int field_cache::option_flags(const bool make_black_border, const bool reverse_rows, const bool reverse_pixel_byte_order)
+{
+	return	  (make_black_border ? 1 : 0)\
+			| (reverse_rows ? 2 : 0)\
+			| (reverse_pixel_byte_order ? 4 : 0);
+}
+
+bool field_cache::load(const char *const filename, const bool make_black_border, const bool reverse_rows, const bool reverse_pixel_byte_order)
+{
+	release();
+
+	unsigned long long source_size = 0;
+	long long source_mtime = 0;
+
+	if(false == source_key(filename, source_size, source_mtime))
+		return false;
+
+	string name = cache_filename(filename);
+
+#ifdef _WIN32
+	ifstream in(name.c_str(), ios::binary | ios::ate);
+
+	if(!in.is_open())
+		return false;
+
+	read_data.resize(static_cast<size_t>(in.tellg()));
+	in.seekg(0);
+
+	if(0 == read_data.size() || !in.read(reinterpret_cast<char *>(&read_data[0]), read_data.size()))
+	{
+		release();
+		return false;
+	}
+
+	data = &read_data[0];
+	data_size = read_data.size();
+#else
+	int fd = open(name.c_str(), O_RDONLY);
+
+	if(-1 == fd)
+		return false;
+
+	struct stat s;
+
+	if(0 != fstat(fd, &s) || 0 == s.st_size)
+	{
+		close(fd);
+		return false;
+	}
+
+	void *mapping = mmap(0, static_cast<size_t>(s.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if(MAP_FAILED == mapping)
+		return false;
+
+	data = static_cast<const unsigned char *>(mapping);
+	data_size = static_cast<size_t>(s.st_size);
+#endif
+
+	// Check the header and the key.
+	field_cache_header h;
+
+	if(data_size < sizeof(h))
+	{
+		release();
+		return false;
+	}
+
+	memcpy(&h, data, sizeof(h));
+
+	size_t path_length = strlen(filename);
+
+	if(0 != memcmp(h.magic, field_cache_magic, sizeof(h.magic)) ||
+		field_cache_version != h.version ||
+		option_flags(make_black_border, reverse_rows, reverse_pixel_byte_order) != h.flags ||
+		source_size != h.source_size ||
+		source_mtime != h.source_mtime ||
+		path_length != h.path_length ||
+		data_size < sizeof(h) + path_length ||
+		0 != memcmp(data + sizeof(h), filename, path_length) ||
+		data_size < h.pixels_offset + static_cast<unsigned long long>(h.px)*h.py*sizeof(float))
+	{
+		release();
+		return false;
+	}
+
+	px = h.px;
+	py = h.py;
+	pixels = reinterpret_cast<const float *>(data + h.pixels_offset);
+
+	return true;
+}
+
+bool field_cache::load_pyramid(min_max_pyramid &p) const
+{
+	if(0 == data)
+		return false;
+
+	field_cache_header h;
+	memcpy(&h, data, sizeof(h));
+
+	if(0 == h.pyramid_offset)
+		return false;
+
+	p.levels.clear();
+
+	unsigned long long offset = h.pyramid_offset;
+
+	for(unsigned long long i = 0; i < h.num_pyramid_levels; i++)
+	{
+		unsigned long long dimensions[3];
+
+		if(data_size < offset + sizeof(dimensions))
+			return false;
+
+		memcpy(dimensions, data + offset, sizeof(dimensions));
+		offset += sizeof(dimensions);
+
+		min_max_pyramid::level l;
+		l.tiles_x = static_cast<size_t>(dimensions[0]);
+		l.tiles_y = static_cast<size_t>(dimensions[1]);
+		l.tile_size = static_cast<size_t>(dimensions[2]);
+
+		size_t num_tiles = l.tiles_x*l.tiles_y;
+
+		if(data_size < offset + 2*num_tiles*sizeof(float))
+			return false;
+
+		const float *values = reinterpret_cast<const float *>(data + offset);
+		l.min_values.assign(values, values + num_tiles);
+		l.max_values.assign(values + num_tiles, values + 2*num_tiles);
+		offset += 2*num_tiles*sizeof(float);
+
+		p.levels.push_back(l);
+	}
+
+	return true;
+}
+
+bool field_cache::load_histogram(luma_histogram &histogram) const
+{
+	if(0 == data)
+		return false;
+
+	field_cache_header h;
+	memcpy(&h, data, sizeof(h));
+
+	if(0 == h.histogram_offset || data_size < h.histogram_offset + sizeof(histogram.counts))
+		return false;
+
+	memcpy(histogram.counts, data + h.histogram_offset, sizeof(histogram.counts));
+
+	return true;
+}
+
+bool field_cache::save(const char *const filename, const bool make_black_border, const bool reverse_rows, const bool reverse_pixel_byte_order, const float_grayscale &l, const min_max_pyramid *const p, const luma_histogram *const histogram)
+{
+	field_cache_header h;
+	memset(&h, 0, sizeof(h));
+
+	if(false == source_key(filename, h.source_size, h.source_mtime))
+		return false;
+
+	memcpy(h.magic, field_cache_magic, sizeof(h.magic));
+	h.version = field_cache_version;
+	h.flags = option_flags(make_black_border, reverse_rows, reverse_pixel_byte_order);
+	h.path_length = strlen(filename);
+	h.px = l.px;
+	h.py = l.py;
+	h.pixels_offset = align_offset(sizeof(h) + h.path_length);
+
+	unsigned long long pixels_end = h.pixels_offset + static_cast<unsigned long long>(l.px)*l.py*sizeof(float);
+
+	unsigned long long pyramid_end = pixels_end;
+
+	if(0 != p && 0 != p->levels.size())
+	{
+		h.pyramid_offset = align_offset(pixels_end);
+		h.num_pyramid_levels = p->levels.size();
+		pyramid_end = h.pyramid_offset;
+
+		for(size_t i = 0; i < p->levels.size(); i++)
+			pyramid_end += 3*sizeof(unsigned long long) + 2*p->levels[i].min_values.size()*sizeof(float);
+	}
+
+	if(0 != histogram)
+		h.histogram_offset = align_offset(pyramid_end);
+
+	// Write to a temporary file and rename it over the cache, so that another process that has
+	// the old cache mapped keeps its (unlinked) copy, instead of seeing it truncated.
+	string name = cache_filename(filename);
+
+	ostringstream temp_name_oss;
+	temp_name_oss << name << ".tmp." << getpid();
+	string temp_name = temp_name_oss.str();
+
+	ofstream out(temp_name.c_str(), ios::binary);
+
+	if(!out.is_open())
+	{
+		cerr << "Failed to write field cache: " << temp_name << endl;
+		return false;
+	}
+
+	out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+	out.write(filename, h.path_length);
+	write_padding(out, sizeof(h) + h.path_length, h.pixels_offset);
+
+	if(0 != l.pixel_data.size())
+		out.write(reinterpret_cast<const char *>(&l.pixel_data[0]), l.pixel_data.size()*sizeof(float));
+
+	if(0 != h.pyramid_offset)
+	{
+		write_padding(out, pixels_end, h.pyramid_offset);
+
+		for(size_t i = 0; i < p->levels.size(); i++)
+		{
+			const min_max_pyramid::level &lev = p->levels[i];
+			unsigned long long dimensions[3] = { lev.tiles_x, lev.tiles_y, lev.tile_size };
+
+			out.write(reinterpret_cast<const char *>(dimensions), sizeof(dimensions));
+			out.write(reinterpret_cast<const char *>(&lev.min_values[0]), lev.min_values.size()*sizeof(float));
+			out.write(reinterpret_cast<const char *>(&lev.max_values[0]), lev.max_values.size()*sizeof(float));
+		}
+	}
+
+	if(0 != h.histogram_offset)
+	{
+		write_padding(out, pyramid_end, h.histogram_offset);
+		out.write(reinterpret_cast<const char *>(histogram->counts), sizeof(histogram->counts));
+	}
+
+	out.close();
+
+	if(!out)
+	{
+		cerr << "Failed to write field cache: " << temp_name << endl;
+		remove(temp_name.c_str());
+		return false;
+	}
+
+#ifdef _WIN32
+	// rename() does not replace an existing file here.
+	remove(name.c_str());
+#endif
+
+	if(0 != rename(temp_name.c_str(), name.c_str()))
+	{
+		cerr << "Failed to write field cache: " << name << endl;
+		remove(temp_name.c_str());
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,85 @@
+#ifndef FIELD_CACHE_H
+#define FIELD_CACHE_H
+
+#include "image.h"
+#include "quadtree.h"
+
+#include <vector>
+using std::vector;
+
+#include <string>
+using std::string;
+
+#include <cstddef>
+
+
+// On-disk cache of a preprocessed float grayscale image (and optionally its min/max pyramid
+// and luma histogram),
+// stored next to the image as file.tga.field. The cache is keyed by the image's path, size,
+// and modification time (in nanoseconds, where available), and by the preprocessing options,
+// and is ignored if any differ. A new cache is written to a temporary file and renamed into place.
+//
+// File layout, all sections aligned to field_cache_alignment bytes:
+// header, image path, pixels (px*py floats, top row first), then the optional pyramid
+// levels (each: tiles_x, tiles_y, tile_size as 64-bit integers, then the min and max arrays),
+// then the optional histogram (luma_histogram::num_bins 64-bit counts).
+//
+// On load, the file is memory-mapped and the pixels are used in place, so a warm start
+// skips reading and decoding the TGA entirely.
+const size_t field_cache_alignment = 64;
+
+class field_cache_header
+{
+public:
+	char magic[8];
+	unsigned int version;
+	unsigned int flags;
+	unsigned long long source_size;
+	long long source_mtime; // Nanoseconds.
+	unsigned long long path_length;
+	unsigned long long pixels_offset;
+	unsigned long long pyramid_offset; // 0 if there is no pyramid.
+	unsigned long long num_pyramid_levels;
+	unsigned long long histogram_offset; // 0 if there is no histogram.
+	unsigned short int px;
+	unsigned short int py;
+};
+
+class field_cache
+{
+public:
+	unsigned short int px;
+	unsigned short int py;
+	const float *pixels;
+
+	field_cache(void);
+	~field_cache(void);
+
+	// Returns false if there is no valid cache for this image and these options.
+	bool load(const char *const filename, const bool make_black_border, const bool reverse_rows, const bool reverse_pixel_byte_order);
+
+	// Copies the cached pyramid, if there is one.
+	bool load_pyramid(min_max_pyramid &p) const;
+
+	// Copies the cached histogram, if there is one.
+	bool load_histogram(luma_histogram &h) const;
+
+	static bool save(const char *const filename, const bool make_black_border, const bool reverse_rows, const bool reverse_pixel_byte_order, const float_grayscale &l, const min_max_pyramid *const p = 0, const luma_histogram *const histogram = 0);
+
+private:
+	const unsigned char *data;
+	size_t data_size;
+	vector<unsigned char> read_data; // Used where memory mapping is not available.
+
+	void release(void);
+
+	static string cache_filename(const char *const filename);
+	static bool source_key(const char *const filename, unsigned long long &size, long long &mtime);
+	static unsigned int option_flags(const bool make_black_border, const bool reverse_rows, const bool reverse_pixel_byte_order);
+
+	// Non-copyable; owns a mapping.
+	field_cache(const field_cache &);
+	field_cache &operator=(const field_cache &);
+};
+
+#endif
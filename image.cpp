@@ -8,18 +8,90 @@ float int_rgb_to_float_grayscale(const unsigned char r, const unsigned char g, c
 			+ 0.0722f*(static_cast<float>(b) / 255.0f);
 }
 
-bool convert_tga_to_float_grayscale(const char *const filename, tga &t, float_grayscale &l, const bool make_black_border, const bool reverse_rows, const bool reverse_pixel_byte_order)
+unsigned long long luma_histogram::total(void) const
 {
-	// http://local.wasp.uwa.edu.au/~pbourke/dataformats/tga/
-	ifstream in(filename, ios::binary);
+	unsigned long long sum = 0;
 
-	if(!in.is_open())
+	for(size_t i = 0; i < num_bins; i++)
+		sum += counts[i];
+
+	return sum;
+}
+
+double luma_histogram::bin_isovalue(size_t bin)
+{
+	if(bin > num_bins - 2)
+		bin = num_bins - 2;
+
+	return (static_cast<double>(bin) + 0.5)/static_cast<double>(num_bins - 1);
+}
+
+double luma_histogram::otsu_isovalue(void) const
+{
+	// http://en.wikipedia.org/wiki/Otsu%27s_method
+	const double num_pixels = static_cast<double>(total());
+
+	double sum_all = 0;
+
+	for(size_t i = 0; i < num_bins; i++)
+		sum_all += static_cast<double>(i)*counts[i];
+
+	double weight_below = 0;
+	double sum_below = 0;
+	double best_variance = 0;
+	size_t best_first = (num_bins - 1)/2;
+	size_t best_last = best_first;
+
+	for(size_t i = 0; i < num_bins - 1; i++)
 	{
-		cerr << "Failed to open TGA file: " << filename << endl;
-		return false;
+		weight_below += counts[i];
+		sum_below += static_cast<double>(i)*counts[i];
+
+		const double weight_above = num_pixels - weight_below;
+
+		if(0 == weight_below || 0 == weight_above)
+			continue;
+
+		const double mean_difference = sum_below/weight_below - (sum_all - sum_below)/weight_above;
+		const double variance = weight_below*weight_above*mean_difference*mean_difference;
+
+		// Splits anywhere in an empty run of bins tie; the run is tracked, so that the split
+		// falls in the middle of the gap rather than next to the lower level.
+		if(variance > best_variance*(1 + 1e-12))
+		{
+			best_variance = variance;
+			best_first = best_last = i;
+		}
+		else if(variance >= best_variance*(1 - 1e-12) && best_last + 1 == i)
+		{
+			best_last = i;
+		}
+	}
+
+	return bin_isovalue((best_first + best_last)/2);
+}
+
+double luma_histogram::percentile_isovalue(const double percent) const
+{
+	const double wanted = percent/100.0*static_cast<double>(total());
+
+	unsigned long long below = 0;
+
+	for(size_t i = 0; i < num_bins; i++)
+	{
+		below += counts[i];
+
+		if(static_cast<double>(below) >= wanted)
+			return bin_isovalue(i);
 	}
 
-	// Read in header, including variable length image descriptor.
+	return bin_isovalue(num_bins - 1);
+}
+
+// Read the header, including the variable length image descriptor, and check the format.
+bool read_tga_header(ifstream &in, tga &t)
+{
+	// http://local.wasp.uwa.edu.au/~pbourke/dataformats/tga/
 	in.read(reinterpret_cast<char *>(&t.idlength), 1);
 	in.read(reinterpret_cast<char *>(&t.colourmaptype), 1);
 	in.read(reinterpret_cast<char *>(&t.datatypecode), 1);
@@ -39,84 +111,203 @@ bool convert_tga_to_float_grayscale(const char *const filename, tga &t, float_gr
 		in.read(&t.idstring[0], t.idlength);
 	}
 
-	// Read pixels, convert to floating point.
-	if(2 != t.datatypecode)
+	if(2 != t.datatypecode || 24 != t.bitsperpixel)
 	{
 		cerr << "TGA file must be in uncompressed/non-RLE 24-bit RGB format." << endl;
 		return false;
 	}
-	else
-	{
-		if(24 != t.bitsperpixel)
-		{
-			cerr << "TGA file must be in uncompressed/non-RLE 24-bit RGB format." << endl;
-			return false;
-		}
 
-		// Read all pixels at once.
-		size_t num_bytes = t.px*t.py*3;
-		t.pixel_data.resize(num_bytes);
-		in.read(reinterpret_cast<char *>(&t.pixel_data[0]), num_bytes);
+	return true;
+}
 
-		if(true == reverse_rows)
-		{
-			// Reverse row order.
-			short unsigned int num_rows_to_swap = t.py;
-			vector<unsigned char> buffer(t.px*3);
+// Read the region's pixels one row at a time, in file order, and hand each row to the converter,
+// with its row number within the region. Only the region's rows and columns are read.
+// Row 0 is the top row if reverse_rows is true (TGA rows are stored bottom row first).
+// The whole image's border pixels are made black before conversion if make_black_border is true,
+// and the converter is told which of the row's pixels, [inner_begin, inner_end), are not border pixels.
+template<class row_converter>
+static bool read_tga_rows(ifstream &in, const tga &t, const pixel_region &r, const bool make_black_border, const bool reverse_rows, const bool reverse_pixel_byte_order, row_converter &convert)
+{
+	const size_t width = r.x_end - r.x_begin;
+	const size_t height = r.y_end - r.y_begin;
+	const streamoff pixels_start = in.tellg();
 
-			if(0 != t.py % 2)
-				num_rows_to_swap--;
+	vector<unsigned char> row(width*3);
 
-			num_rows_to_swap /= 2;
+	const size_t file_y_begin = reverse_rows ? t.py - r.y_end : r.y_begin;
 
-			for(short unsigned int i = 0; i < num_rows_to_swap; i++)
-			{
-				size_t y_first = i*t.px*3;
-				size_t y_last = (t.py - 1 - i)*t.px*3;
+	for(size_t file_y = file_y_begin; file_y < file_y_begin + height; file_y++)
+	{
+		// Whole rows follow one another in the file; otherwise skip to the region's columns.
+		if(width != t.px || file_y_begin == file_y)
+			in.seekg(pixels_start + static_cast<streamoff>((file_y*t.px + r.x_begin)*3));
 
-				memcpy(&buffer[0], &t.pixel_data[y_first], t.px*3);
-				memcpy(&t.pixel_data[y_first], &t.pixel_data[y_last], t.px*3);
-				memcpy(&t.pixel_data[y_last], &buffer[0], t.px*3);
-			}
+		if(!in.read(reinterpret_cast<char *>(&row[0]), row.size()))
+		{
+			cerr << "TGA file is truncated." << endl;
+			return false;
 		}
 
+		const size_t y = reverse_rows ? t.py - 1 - file_y : file_y;
+
+		size_t inner_begin = 0;
+		size_t inner_end = width;
+
 		if(true == make_black_border)
 		{
 			// Make border pixels black.
-			for(unsigned short int x = 0; x < t.px; x++)
+			if(0 == y || t.py - 1u == y)
 			{
-				for(unsigned short int y = 0; y < t.py; y++)
+				memset(&row[0], 0, row.size());
+				inner_end = 0;
+			}
+			else
+			{
+				if(0 == r.x_begin)
 				{
-					if(x == 0 || x == t.px - 1 || y == 0 || y == t.py - 1)
-					{
-						size_t index = y*t.px*3 + x*3;
-						t.pixel_data[index] = 0;
-						t.pixel_data[index + 1] = 0;
-						t.pixel_data[index + 2] = 0;
-					}
+					memset(&row[0], 0, 3);
+					inner_begin = 1;
+				}
+
+				if(t.px == r.x_end)
+				{
+					memset(&row[(width - 1)*3], 0, 3);
+					inner_end = width - 1;
 				}
 			}
 		}
 
-		// Fill floating point grayscale image.
-		l.px = t.px;
-		l.py = t.py;
-		l.pixel_data.resize(num_bytes/3, 0);
-
-		for(size_t index = 0; index < num_bytes; index += 3)
+		if(reverse_pixel_byte_order)
 		{
-			if(reverse_pixel_byte_order)
+			// Swap red and blue pixels.
+			for(size_t index = 0; index < row.size(); index += 3)
 			{
-				// Swap red and blue pixels.
-				unsigned char temp = t.pixel_data[index];
-				t.pixel_data[index] = t.pixel_data[index + 2];
-				t.pixel_data[index + 2] = temp;
+				unsigned char temp = row[index];
+				row[index] = row[index + 2];
+				row[index + 2] = temp;
 			}
-
-			// Convert to luma.
-			l.pixel_data[index/3] = int_rgb_to_float_grayscale(t.pixel_data[index], t.pixel_data[index + 1], t.pixel_data[index + 2]);
 		}
+
+		convert(y - r.y_begin, &row[0], inner_begin, inner_end);
 	}
 
 	return true;
 }
+
+// Counts the pixels [x_begin, x_end) of a converted row into the histogram, if there is one.
+template<class pixel>
+static void add_row_to_histogram(luma_histogram *const histogram, const pixel *const row, const size_t x_begin, const size_t x_end)
+{
+	if(0 == histogram)
+		return;
+
+	for(size_t x = x_begin; x < x_end; x++)
+		histogram->add(row[x]);
+}
+
+class float_row_converter
+{
+public:
+	float_grayscale &l;
+	luma_histogram *histogram;
+
+	float_row_converter(float_grayscale &src_l, luma_histogram *const src_histogram) : l(src_l), histogram(src_histogram) {}
+
+	void operator()(const size_t y, const unsigned char *const rgb, const size_t inner_begin, const size_t inner_end)
+	{
+		float *out = &l.pixel_data[y*l.px];
+
+		// Convert to luma.
+		for(size_t x = 0; x < l.px; x++)
+			out[x] = int_rgb_to_float_grayscale(rgb[x*3], rgb[x*3 + 1], rgb[x*3 + 2]);
+
+		add_row_to_histogram(histogram, out, inner_begin, inner_end);
+	}
+};
+
+class byte_row_converter
+{
+public:
+	byte_grayscale &l;
+	luma_histogram *histogram;
+
+	byte_row_converter(byte_grayscale &src_l, luma_histogram *const src_histogram) : l(src_l), histogram(src_histogram) {}
+
+	void operator()(const size_t y, const unsigned char *const rgb, const size_t inner_begin, const size_t inner_end)
+	{
+		unsigned char *out = &l.pixel_data[y*l.px];
+
+		// Convert to luma, rounded to the nearest of 0 ... 255.
+		for(size_t x = 0; x < l.px; x++)
+			out[x] = static_cast<unsigned char>(int_rgb_to_float_grayscale(rgb[x*3], rgb[x*3 + 1], rgb[x*3 + 2])*255.0f + 0.5f);
+
+		add_row_to_histogram(histogram, out, inner_begin, inner_end);
+	}
+};
+
+// Convert the region of the image, or the whole image if region is null.
+template<class row_converter, class grayscale>
+static bool convert_tga(const char *const filename, tga &t, grayscale &l, const pixel_region *const region, const bool make_black_border, const bool reverse_rows, const bool reverse_pixel_byte_order, luma_histogram *const histogram)
+{
+	ifstream in(filename, ios::binary);
+
+	if(!in.is_open())
+	{
+		cerr << "Failed to open TGA file: " << filename << endl;
+		return false;
+	}
+
+	if(false == read_tga_header(in, t))
+		return false;
+
+	// The raw pixels are converted a row at a time, and never stored whole.
+	vector<unsigned char>().swap(t.pixel_data);
+
+	pixel_region r(0, 0, t.px, t.py);
+
+	if(0 != region)
+	{
+		r = *region;
+
+		if(r.x_end > t.px)
+			r.x_end = t.px;
+
+		if(r.y_end > t.py)
+			r.y_end = t.py;
+	}
+
+	if(r.x_begin >= r.x_end || r.y_begin >= r.y_end)
+	{
+		cerr << "TGA region is empty, or outside of the image." << endl;
+		return false;
+	}
+
+	// Fill grayscale image.
+	l.px = r.x_end - r.x_begin;
+	l.py = r.y_end - r.y_begin;
+	l.pixel_data.resize(static_cast<size_t>(l.px)*l.py, 0);
+
+	row_converter convert(l, histogram);
+
+	return read_tga_rows(in, t, r, make_black_border, reverse_rows, reverse_pixel_byte_order, convert);
+}
+
+bool convert_tga_to_float_grayscale(const char *const filename, tga &t, float_grayscale &l, const bool make_black_border, const bool reverse_rows, const bool reverse_pixel_byte_order, luma_histogram *const histogram)
+{
+	return convert_tga<float_row_converter>(filename, t, l, 0, make_black_border, reverse_rows, reverse_pixel_byte_order, histogram);
+}
+
+bool convert_tga_to_byte_grayscale(const char *const filename, tga &t, byte_grayscale &l, const bool make_black_border, const bool reverse_rows, const bool reverse_pixel_byte_order, luma_histogram *const histogram)
+{
+	return convert_tga<byte_row_converter>(filename, t, l, 0, make_black_border, reverse_rows, reverse_pixel_byte_order, histogram);
+}
+
+bool convert_tga_region_to_float_grayscale(const char *const filename, tga &t, float_grayscale &l, const pixel_region &region, const bool make_black_border, const bool reverse_rows, const bool reverse_pixel_byte_order, luma_histogram *const histogram)
+{
+	return convert_tga<float_row_converter>(filename, t, l, &region, make_black_border, reverse_rows, reverse_pixel_byte_order, histogram);
+}
+
+bool convert_tga_region_to_byte_grayscale(const char *const filename, tga &t, byte_grayscale &l, const pixel_region &region, const bool make_black_border, const bool reverse_rows, const bool reverse_pixel_byte_order, luma_histogram *const histogram)
+{
+	return convert_tga<byte_row_converter>(filename, t, l, &region, make_black_border, reverse_rows, reverse_pixel_byte_order, histogram);
+}
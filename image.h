@@ -9,6 +9,7 @@ using std::ifstream;
 
 #include <ios>
 using std::ios;
+using std::streamoff;
 
 #include <iostream>
 using std::cout;
@@ -16,6 +17,7 @@ using std::cerr;
 using std::endl;
 
 #include <cstring>
+#include <cstddef>
 
 
 // http://local.wasp.uwa.edu.au/~pbourke/dataformats/tga/
@@ -48,7 +50,98 @@ public:
 	vector<float> pixel_data;
 };
 
+// 8-bit luma, for masks that do not need more: a quarter of the memory of float_grayscale.
+// A pixel's value is pixel_data[i]/255.0f.
+class byte_grayscale
+{
+public:
+	unsigned short int px;
+	unsigned short int py;
+	vector<unsigned char> pixel_data;
+};
+
+// Counts of luma values in 256 bins, where bin b holds the values nearest to b/255.
+// Used to pick an isovalue from the image itself.
+class luma_histogram
+{
+public:
+	static const size_t num_bins = 256;
+	unsigned long long counts[num_bins];
+
+	luma_histogram(void)
+	{
+		clear();
+	}
+
+	void clear(void)
+	{
+		memset(counts, 0, sizeof(counts));
+	}
+
+	inline void add(const float value)
+	{
+		const float bin = value*255.0f + 0.5f;
+
+		if(bin <= 0)
+			counts[0]++;
+		else if(bin >= num_bins - 1)
+			counts[num_bins - 1]++;
+		else
+			counts[static_cast<size_t>(bin)]++;
+	}
+
+	inline void add(const unsigned char value)
+	{
+		counts[value]++;
+	}
+
+	unsigned long long total(void) const;
+
+	// The isovalues below fall halfway between two bins, and put the bins at or below
+	// the chosen bin outside of the isosurface.
+
+	// Otsu's method: the split that maximizes the variance between the two classes,
+	// in the middle of the run of splits that tie for it. 0.5 if the image has only one level.
+	double otsu_isovalue(void) const;
+
+	// The split with at least percent % of the pixels outside.
+	double percentile_isovalue(const double percent) const;
+
+	// Halfway between bin and bin + 1, with bin limited to 0 ... 254, so that 0 < isovalue < 1.
+	static double bin_isovalue(size_t bin);
+};
+
+// A rectangle of pixels, x_begin <= x < x_end and y_begin <= y < y_end, with row 0 at the top.
+class pixel_region
+{
+public:
+	unsigned short int x_begin;
+	unsigned short int y_begin;
+	unsigned short int x_end;
+	unsigned short int y_end;
+
+	pixel_region(const unsigned short int src_x_begin = 0, const unsigned short int src_y_begin = 0, const unsigned short int src_x_end = 0, const unsigned short int src_y_end = 0)
+	{
+		x_begin = src_x_begin;
+		y_begin = src_y_begin;
+		x_end = src_x_end;
+		y_end = src_y_end;
+	}
+};
+
 float int_rgb_to_float_grayscale(const unsigned char r, const unsigned char g, const unsigned char b);
-bool convert_tga_to_float_grayscale(const char *const filename, tga &t, float_grayscale &l, const bool make_black_border = false, const bool reverse_rows = true, const bool reverse_pixel_byte_order = true);
+bool read_tga_header(ifstream &in, tga &t);
+
+// The TGA pixels are read and converted one row at a time; t.pixel_data is left empty.
+// If histogram is not null, the luma is also counted into it as it is converted,
+// leaving out the black border, if there is one.
+bool convert_tga_to_float_grayscale(const char *const filename, tga &t, float_grayscale &l, const bool make_black_border = false, const bool reverse_rows = true, const bool reverse_pixel_byte_order = true, luma_histogram *const histogram = 0);
+bool convert_tga_to_byte_grayscale(const char *const filename, tga &t, byte_grayscale &l, const bool make_black_border = false, const bool reverse_rows = true, const bool reverse_pixel_byte_order = true, luma_histogram *const histogram = 0);
+
+// As above, for just the pixels in a region of the image, which is clipped to the image.
+// Only the region's rows and columns are read from the file. t holds the whole image's header,
+// and l the region's pixels. The whole image's border is made black if make_black_border is true.
+bool convert_tga_region_to_float_grayscale(const char *const filename, tga &t, float_grayscale &l, const pixel_region &region, const bool make_black_border = false, const bool reverse_rows = true, const bool reverse_pixel_byte_order = true, luma_histogram *const histogram = 0);
+bool convert_tga_region_to_byte_grayscale(const char *const filename, tga &t, byte_grayscale &l, const pixel_region &region, const bool make_black_border = false, const bool reverse_rows = true, const bool reverse_pixel_byte_order = true, luma_histogram *const histogram = 0);
 
 #endif
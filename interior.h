@@ -0,0 +1,143 @@
+#ifndef INTERIOR_H
+#define INTERIOR_H
+
+#include <vector>
+using std::vector;
+
+#include <list>
+using std::list;
+
+#include "primitives.h"
+#include "marching_squares.h"
+
+
+// Merges the fully-inside grid squares (case 15) into rectangles as the march
+// proceeds, and emits two triangles per rectangle instead of two per grid square.
+//
+// Each row's case 15 squares are first grouped into horizontal runs. A rectangle
+// that is open from the previous rows grows down into the new row if every square
+// under it is a case 15 square, otherwise it is closed and emitted; whatever case 15
+// squares are left over in the new row open new rectangles.
+//
+// Rectangle corners are taken from the grid square vertices themselves,
+// so they coincide exactly with the vertices of the neighbouring boundary squares.
+class interior_mesher
+{
+public:
+	interior_mesher(void)
+	{
+		last_bottom = 0;
+	}
+
+	// Add a case 15 grid square from column x of the current row.
+	void add(const grid_square &g, const unsigned short int x)
+	{
+		if(inside.size() < static_cast<size_t>(x) + 1)
+		{
+			inside.resize(x + 1, 0);
+			column_x.resize(x + 2, 0);
+		}
+
+		inside[x] = 1;
+		column_x[x] = g.vertex[0].x;
+		column_x[x + 1] = g.vertex[3].x;
+	}
+
+	// Call once a row of grid squares is complete, where top_y and bottom_y
+	// are the y coordinates of the row's top and bottom edges.
+	void end_row(const double top_y, const double bottom_y, vector<triangle> &triangles)
+	{
+		// Grow or close the open rectangles.
+		list<rectangle>::iterator i = open_rectangles.begin();
+
+		while(open_rectangles.end() != i)
+		{
+			bool covered = (i->x_end <= inside.size());
+
+			for(size_t x = i->x_begin; covered && x < i->x_end; x++)
+				if(0 == inside[x])
+					covered = false;
+
+			if(true == covered)
+			{
+				for(size_t x = i->x_begin; x < i->x_end; x++)
+					inside[x] = 0;
+
+				i++;
+			}
+			else
+			{
+				emit(*i, triangles);
+				open_rectangles.erase(i++);
+			}
+		}
+
+		// Open new rectangles from the remaining runs.
+		for(size_t x = 0; x < inside.size(); x++)
+		{
+			if(0 == inside[x])
+				continue;
+
+			rectangle r;
+			r.x_begin = x;
+			r.top = top_y;
+
+			while(x < inside.size() && 0 != inside[x])
+				inside[x++] = 0;
+
+			r.x_end = x;
+			open_rectangles.push_back(r);
+		}
+
+		last_bottom = bottom_y;
+	}
+
+	// Emit all rectangles that are still open.
+	void flush(vector<triangle> &triangles)
+	{
+		for(list<rectangle>::iterator i = open_rectangles.begin(); i != open_rectangles.end(); i++)
+			emit(*i, triangles);
+
+		open_rectangles.clear();
+	}
+
+private:
+	// Spans columns [x_begin, x_end) from the y coordinate top down to the last completed row.
+	class rectangle
+	{
+	public:
+		size_t x_begin;
+		size_t x_end;
+		double top;
+	};
+
+	list<rectangle> open_rectangles;
+	vector<char> inside;
+	vector<double> column_x;
+	double last_bottom;
+
+	void emit(const rectangle &r, vector<triangle> &triangles)
+	{
+		// Corner vertex order: 03
+		//                      12
+		// e.g.: clockwise, as in OpenGL, matching case 15
+		vertex_2 v0(column_x[r.x_begin], r.top);
+		vertex_2 v1(column_x[r.x_begin], last_bottom);
+		vertex_2 v2(column_x[r.x_end], last_bottom);
+		vertex_2 v3(column_x[r.x_end], r.top);
+
+		triangle t;
+
+		t.vertex[0] = v0;
+		t.vertex[1] = v1;
+		t.vertex[2] = v3;
+		triangles.push_back(t);
+
+		t.vertex[0] = v3;
+		t.vertex[1] = v1;
+		t.vertex[2] = v2;
+		triangles.push_back(t);
+	}
+};
+
+#endif
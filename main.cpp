@@ -1,6 +1,22 @@
 #include "main.h"
 
 
+// Prints each level of a progressive march as it completes.
+class preview_printer
+{
+public:
+	double step_size;
+
+	void level(const size_t stride, const vector<line_segment> &, const vector<triangle> &, const geometry_stats &stats, const size_t boundary_count, const size_t)
+	{
+		cout << "Stride " << stride << ": ";
+		cout << stats.num_line_segments << " line segments, length " << stats.length << ", ";
+		cout << stats.num_triangles << " triangles, area " << stats.area << ", ";
+		cout << "box counting dimension " << box_counting_dimension(boundary_count, step_size*stride) << endl;
+	}
+};
+
+
 // Cat image from: http://www.iacuc.arizona.edu/training/cats/index.html
 int main(int argc, char **argv)
 {
@@ -10,18 +26,346 @@ int main(int argc, char **argv)
 	// Example command for standard binary image: ms figure1.tga 1e-3 0.5
 	// Example command for blurred binary image: ms figure3.tga 1e-3 0.5
 	// Example command for noise binary image: ms figure5.tga 1e-3 0.5
-	if(4 != argc)
+	// Example command for simplified contours: ms figure1.tga 1e-3 0.5 -simplify 1e-6
+	// Example command for merged interior triangles: ms figure1.tga 1e-3 0.5 -merge_interior
+	// Example command for pre-smoothed noise binary image: ms figure5.tga 1e-3 0.5 -gaussian_blur 2
+	// Example command for adaptive (quadtree) march: ms figure1.tga 1e-3 0.5 -adaptive
+	// Example command for per-component statistics without small blobs: ms figure5.tga 1e-3 0.5 -components -min_area 1e-10
+	// Example command for caching the preprocessed image between runs: ms figure1.tga 1e-3 0.5 -cache
+	// Example command for a low-memory 8-bit field: ms figure1.tga 1e-3 0.5 -byte_field
+	// Example command for streaming the geometry to a text file: ms figure1.tga 1e-3 0.5 -export figure1.txt
+	// Example command for coarse-to-fine previews: ms figure1.tga 1e-3 0.5 -progressive
+	// Example command for an isovalue chosen by Otsu's method: ms figure3.tga 1e-3 otsu
+	// Example command for an isovalue with 90% of the pixels outside: ms figure3.tga 1e-3 90%
+	// Example command for the contours in a region of a large image: ms figure1.tga 1e-3 0.5 -roi 100 100 299 199
+	// Example command for a query server on a local socket: ms -server /tmp/ms.sock
+	if(2 <= argc && string("-server") == argv[1])
+		return run_server(3 <= argc ? argv[2] : 0);
+
+	// Example command for the differential self-test of the marching paths: ms -selftest 1000 7
+	if(2 <= argc && string("-selftest") == argv[1])
+	{
+		unsigned long int iterations = 200;
+		unsigned long int seed = 1;
+
+		if(3 <= argc)
+			istringstream(argv[2]) >> iterations;
+
+		if(4 <= argc)
+			istringstream(argv[3]) >> seed;
+
+		return run_selftest(iterations, seed);
+	}
+
+	// Example command for timing the table-driven kernel against the reference: ms -benchmark 2000 5
+	if(2 <= argc && string("-benchmark") == argv[1])
 	{
-		cout << "Usage: " << argv[0] << " file.tga template_width_in_metres isovalue" << endl;
+		unsigned short int size = 2000;
+		unsigned long int repetitions = 5;
+		unsigned long int seed = 1;
+
+		if(3 <= argc)
+			istringstream(argv[2]) >> size;
+
+		if(4 <= argc)
+			istringstream(argv[3]) >> repetitions;
+
+		if(5 <= argc)
+			istringstream(argv[4]) >> seed;
+
+		return run_benchmark(size, repetitions, seed);
+	}
+
+	if(4 > argc)
+	{
+		cout << "Usage: " << argv[0] << " file.tga template_width_in_metres isovalue|otsu|percent% [options]" << endl;
+		cout << "       " << argv[0] << " -server [socket_path]   (see server.h; stdin/stdout without a socket path)" << endl;
+		cout << "       " << argv[0] << " -selftest [iterations] [seed]   (see selftest.h)" << endl;
+		cout << "       " << argv[0] << " -benchmark [size_in_pixels] [repetitions] [seed]   (see selftest.h)" << endl;
+		cout << "Options:" << endl;
+		cout << "  -simplify tolerance_in_metres   Merge contour line segments that stay within the tolerance" << endl;
+		cout << "  -merge_interior                 Merge fully-inside grid squares into rectangles" << endl;
+		cout << "  -box_blur radius_in_pixels      Smooth the image with a box filter before marching" << endl;
+		cout << "  -gaussian_blur sigma_in_pixels  Smooth the image with a Gaussian filter before marching" << endl;
+		cout << "  -adaptive                       March at pixel level only where tiles straddle the isovalue" << endl;
+		cout << "  -components                     Print statistics for each connected component" << endl;
+		cout << "  -min_area area_in_square_metres Drop connected components with less area" << endl;
+		cout << "  -cache                          Reuse (or write) the preprocessed image in file.tga.field" << endl;
+		cout << "  -byte_field                     Keep the image as 8-bit luma, and classify with integer compares" << endl;
+		cout << "  -export file.txt                Stream the geometry to a text file instead of storing it" << endl;
+		cout << "  -progressive                    Print previews at strides 8, 4, and 2 before the full march" << endl;
+		cout << "  -roi x0 y0 x1 y1                Read and march only this rectangle of pixels (row 0 at the top)" << endl;
+		cout << "  -roi_metres x0 y0 x1 y1         As -roi, in metres right and down from the top left of the grid" << endl;
 		return 0;
 	}
 
-	// Read a 24-bit uncompressed/non-RLE Targa file, and then convert it to a floating point grayscale image.
-	cout << "Reading luma..." << endl;
-	cout << endl;
+	// Get options.
+	for(int i = 4; i < argc; i++)
+	{
+		string option = argv[i];
+
+		if("-simplify" == option && i + 1 < argc)
+		{
+			istringstream option_iss(argv[++i]);
+			option_iss >> simplify_tolerance;
+
+			if(0 >= simplify_tolerance)
+			{
+				cout << "Simplify tolerance must be > 0." << endl;
+				return 0;
+			}
+		}
+		else if("-merge_interior" == option)
+		{
+			merge_interior = true;
+		}
+		else if(("-box_blur" == option || "-gaussian_blur" == option) && i + 1 < argc)
+		{
+			smoothing_filter = ("-box_blur" == option) ? smoothed_rows::box_filter : smoothed_rows::gaussian_filter;
+
+			istringstream option_iss(argv[++i]);
+			option_iss >> smoothing_size;
+
+			if(0 >= smoothing_size)
+			{
+				cout << "Blur size must be > 0." << endl;
+				return 0;
+			}
+		}
+		else if("-adaptive" == option)
+		{
+			adaptive = true;
+		}
+		else if("-components" == option)
+		{
+			label_components = true;
+			print_components = true;
+		}
+		else if("-cache" == option)
+		{
+			use_cache = true;
+		}
+		else if("-byte_field" == option)
+		{
+			byte_field = true;
+		}
+		else if("-export" == option && i + 1 < argc)
+		{
+			export_filename = argv[++i];
+		}
+		else if("-progressive" == option)
+		{
+			progressive = true;
+		}
+		else if(("-roi" == option || "-roi_metres" == option) && i + 4 < argc)
+		{
+			use_roi = true;
+			roi_in_metres = ("-roi_metres" == option);
+
+			for(size_t j = 0; j < 4; j++)
+				istringstream(argv[++i]) >> roi[j];
+
+			if(0 > roi[0] || 0 > roi[1] || roi[0] > roi[2] || roi[1] > roi[3])
+			{
+				cout << "Region of interest must be x0 y0 x1 y1, with 0 <= x0 <= x1 and 0 <= y0 <= y1." << endl;
+				return 0;
+			}
+		}
+		else if("-min_area" == option && i + 1 < argc)
+		{
+			label_components = true;
+
+			istringstream option_iss(argv[++i]);
+			option_iss >> min_area;
+
+			if(0 > min_area)
+			{
+				cout << "Minimum area must be >= 0." << endl;
+				return 0;
+			}
+		}
+		else
+		{
+			cout << "Unknown option: " << option << endl;
+			return 0;
+		}
+	}
+
+	// The adaptive march visits tiles out of row order, and reads the whole image.
+	if(true == adaptive && (0 != simplify_tolerance || true == merge_interior || smoothed_rows::no_filter != smoothing_filter))
+	{
+		cout << "-adaptive cannot be combined with -simplify, -merge_interior, or blurring." << endl;
+		return 0;
+	}
+
+	// Component labelling sees every grid square's geometry, and writes it out of row order.
+	if(true == label_components && (true == adaptive || 0 != simplify_tolerance || true == merge_interior))
+	{
+		cout << "-components and -min_area cannot be combined with -adaptive, -simplify, or -merge_interior." << endl;
+		return 0;
+	}
+
+	// Exported geometry is streamed straight from the plain march.
+	if(0 != export_filename && (0 != simplify_tolerance || true == merge_interior || smoothed_rows::no_filter != smoothing_filter || true == adaptive || true == label_components))
+	{
+		cout << "-export cannot be combined with -simplify, -merge_interior, blurring, -adaptive, or -components." << endl;
+		return 0;
+	}
+
+	// An isovalue of otsu, or of a percentage, is picked from the luma histogram,
+	// which is gathered while the image is converted.
+	string isovalue_arg = argv[3];
+
+	if("otsu" == isovalue_arg)
+	{
+		auto_isovalue = otsu_auto_isovalue;
+	}
+	else if(0 != isovalue_arg.size() && '%' == isovalue_arg[isovalue_arg.size() - 1])
+	{
+		auto_isovalue = percentile_auto_isovalue;
+
+		istringstream percent_iss(isovalue_arg.substr(0, isovalue_arg.size() - 1));
+		percent_iss >> isovalue_percent;
+
+		if(0 >= isovalue_percent || 100 <= isovalue_percent)
+		{
+			cout << "Isovalue percentage must be 0 < p < 100." << endl;
+			return 0;
+		}
+	}
+
+	// The cache holds the whole image.
+	if(true == use_roi && true == use_cache)
+	{
+		cout << "-roi and -roi_metres cannot be combined with -cache." << endl;
+		return 0;
+	}
+
+	// Blurring a window would clamp at, and black out, its edges, which are not the image's.
+	if(true == use_roi && smoothed_rows::no_filter != smoothing_filter)
+	{
+		cout << "-roi and -roi_metres cannot be combined with -box_blur or -gaussian_blur." << endl;
+		return 0;
+	}
+
+	// The region's window of pixels is found from the TGA header alone: the pixels covering
+	// the rectangle, and a one pixel apron around them, clipped to the image.
+	if(true == use_roi)
+	{
+		ifstream header_in(argv[1], ios::binary);
+
+		if(!header_in.is_open() || false == read_tga_header(header_in, tga_texture))
+		{
+			cout << "Failed to read TGA header: " << argv[1] << endl;
+			return 0;
+		}
+
+		double window[4] = { roi[0], roi[1], roi[2], roi[3] };
+
+		if(true == roi_in_metres)
+		{
+			double width = 0;
+			istringstream(argv[2]) >> width;
+
+			const double pixel_size = width/static_cast<double>(tga_texture.px - 1);
+
+			for(size_t j = 0; j < 4; j++)
+				window[j] /= pixel_size;
+		}
+
+		window[0] = floor(window[0]) - 1;
+		window[1] = floor(window[1]) - 1;
+		window[2] = ceil(window[2]) + 2; // Exclusive.
+		window[3] = ceil(window[3]) + 2;
+
+		roi_window.x_begin = static_cast<unsigned short int>(window[0] < 0 ? 0 : (window[0] > tga_texture.px ? tga_texture.px : window[0]));
+		roi_window.y_begin = static_cast<unsigned short int>(window[1] < 0 ? 0 : (window[1] > tga_texture.py ? tga_texture.py : window[1]));
+		roi_window.x_end = static_cast<unsigned short int>(window[2] > tga_texture.px ? tga_texture.px : window[2]);
+		roi_window.y_end = static_cast<unsigned short int>(window[3] > tga_texture.py ? tga_texture.py : window[3]);
+	}
+
+	luma_histogram *const wanted_histogram = (no_auto_isovalue != auto_isovalue) ? &histogram : 0;
 
-	if(false == convert_tga_to_float_grayscale(argv[1], tga_texture, luma, true, true, true))
+	// The previews are strided plain marches of the float field.
+	if(true == progressive && (0 != simplify_tolerance || true == merge_interior || smoothed_rows::no_filter != smoothing_filter || true == adaptive || true == label_components || 0 != export_filename || true == byte_field))
+	{
+		cout << "-progressive cannot be combined with options other than -cache." << endl;
 		return 0;
+	}
+
+	// The 8-bit field is marched directly, without the float image that the other options work on.
+	if(true == byte_field && (0 != simplify_tolerance || true == merge_interior || smoothed_rows::no_filter != smoothing_filter || true == adaptive || true == label_components || true == use_cache))
+	{
+		cout << "-byte_field cannot be combined with other options." << endl;
+		return 0;
+	}
+
+	// Read a 24-bit uncompressed/non-RLE Targa file, and then convert it to a floating point grayscale image.
+	// With -cache, a valid cache skips the TGA entirely.
+	if(true == byte_field)
+	{
+		cout << "Reading 8-bit luma..." << endl;
+		cout << endl;
+
+		bool converted;
+
+		if(true == use_roi)
+			converted = convert_tga_region_to_byte_grayscale(argv[1], tga_texture, byte_luma, roi_window, true, true, true, wanted_histogram);
+		else
+			converted = convert_tga_to_byte_grayscale(argv[1], tga_texture, byte_luma, true, true, true, wanted_histogram);
+
+		if(false == converted)
+			return 0;
+
+		luma.px = byte_luma.px;
+		luma.py = byte_luma.py;
+	}
+	else if(true == use_cache && true == luma_cache.load(argv[1], true, true, true))
+	{
+		cout << "Reading luma from cache..." << endl;
+		cout << endl;
+
+		luma.px = luma_cache.px;
+		luma.py = luma_cache.py;
+		luma_pixels = luma_cache.pixels;
+
+		have_pyramid = luma_cache.load_pyramid(pyramid);
+
+		// Caches written with -cache always hold the histogram, so this is only a fallback.
+		if(0 != wanted_histogram && false == luma_cache.load_histogram(histogram))
+			for(size_t y = 1; y + 1 < luma.py; y++)
+				for(size_t x = 1; x + 1 < luma.px; x++)
+					histogram.add(luma_pixels[y*luma.px + x]);
+	}
+	else
+	{
+		cout << "Reading luma..." << endl;
+		cout << endl;
+
+		bool converted;
+
+		// The cache always gets the histogram, for later runs with an automatic isovalue.
+		if(true == use_roi)
+			converted = convert_tga_region_to_float_grayscale(argv[1], tga_texture, luma, roi_window, true, true, true, wanted_histogram);
+		else
+			converted = convert_tga_to_float_grayscale(argv[1], tga_texture, luma, true, true, true, (true == use_cache) ? &histogram : wanted_histogram);
+
+		if(false == converted)
+			return 0;
+
+		luma_pixels = &luma.pixel_data[0];
+
+		if(true == use_cache)
+		{
+			pyramid.build(luma_pixels, luma.px, luma.py);
+			have_pyramid = true;
+
+			field_cache::save(argv[1], true, true, true, luma, &pyramid, &histogram);
+		}
+	}
+
+	image_px = (true == use_roi) ? tga_texture.px : luma.px;
+	image_py = (true == use_roi) ? tga_texture.py : luma.py;
 
 	// Too small.
 	if(luma.px < 3 || luma.py < 3)
@@ -37,13 +381,24 @@ int main(int argc, char **argv)
 	istringstream iss(argv[2]);
 	iss >> template_width;
 	inverse_width = 1.0/template_width;
-	step_size = template_width/static_cast<double>(luma.px - 1);
-	template_height = step_size*(luma.py - 1); // Assumes square pixels.
+	step_size = template_width/static_cast<double>(image_px - 1);
+	template_height = step_size*(image_py - 1); // Assumes square pixels.
 
 	// Get marching squares isovalue.
-	iss.clear();
-	iss.str(argv[3]);
-	iss >> isovalue;
+	if(otsu_auto_isovalue == auto_isovalue)
+	{
+		isovalue = histogram.otsu_isovalue();
+	}
+	else if(percentile_auto_isovalue == auto_isovalue)
+	{
+		isovalue = histogram.percentile_isovalue(isovalue_percent);
+	}
+	else
+	{
+		iss.clear();
+		iss.str(argv[3]);
+		iss >> isovalue;
+	}
 
 	if(0 >= isovalue || 1 <= isovalue)
 	{
@@ -53,7 +408,7 @@ int main(int argc, char **argv)
 
 	// Print basic information.
 	cout << "Template info: " << endl;
-	cout << luma.px << " x " << luma.py << " pixels" << endl;
+	cout << image_px << " x " << image_py << " pixels" << endl;
 	cout << template_width << " x " << template_height << " metres" << endl;
 	cout << endl;
 
@@ -61,114 +416,198 @@ int main(int argc, char **argv)
 	grid_y_max = template_height/2.0;
 	
 	cout << "Grid info: " << endl;
-	cout << luma.px - 1 << " x " << luma.py - 1 << " grid squares" << endl;
+	cout << image_px - 1 << " x " << image_py - 1 << " grid squares" << endl;
 	cout << "x min (-x max): " << grid_x_min << endl;
 	cout << "y min (-y max): " << -grid_y_max << endl;
-	cout << "Isovalue: " << isovalue << endl;
+
+	if(true == use_roi)
+	{
+		cout << "Region of interest: pixels x " << roi_window.x_begin << " to " << roi_window.x_end - 1;
+		cout << ", y " << roi_window.y_begin << " to " << roi_window.y_end - 1 << " (with apron), ";
+		cout << luma.px - 1 << " x " << luma.py - 1 << " grid squares" << endl;
+	}
+
+	cout << "Isovalue: " << isovalue;
+
+	if(otsu_auto_isovalue == auto_isovalue)
+		cout << " (Otsu)";
+	else if(percentile_auto_isovalue == auto_isovalue)
+		cout << " (" << isovalue_percent << "% of pixels outside)";
+
 	cout << endl;
 
+	if(0 != simplify_tolerance)
+		cout << "Simplify tolerance: " << simplify_tolerance << " metres" << endl;
 
-	// Generate geometric primitives using marching squares.
-	grid_square g;
+	if(true == merge_interior)
+		cout << "Merging interior grid squares" << endl;
+
+	if(smoothed_rows::box_filter == smoothing_filter)
+		cout << "Box blur radius: " << smoothing_size << " pixels" << endl;
+	else if(smoothed_rows::gaussian_filter == smoothing_filter)
+		cout << "Gaussian blur sigma: " << smoothing_size << " pixels" << endl;
+
+	if(true == adaptive)
+		cout << "Adaptive march, " << min_max_pyramid::base_tile_size << " x " << min_max_pyramid::base_tile_size << " grid square tiles" << endl;
+
+	if(true == label_components)
+		cout << "Minimum component area: " << min_area << " square metres" << endl;
+
+	if(true == byte_field)
+		cout << "8-bit field, inside at luma >= " << byte_threshold(isovalue) << "/255" << endl;
 
-	cout << "Generating geometric primitives..." << endl;
 	cout << endl;
 
-	double grid_x_pos = grid_x_min; // Start at minimum x.
-	double grid_y_pos = grid_y_max; // Start at maximum y.
 
-	// Begin march.
-	for(short unsigned int y = 0; y < luma.py - 1; y++, grid_y_pos -= step_size, grid_x_pos = grid_x_min)
+	// The position of the top left pixel of the field being marched. A region is marched
+	// in the whole image's frame; the statistics' bounds still start from the whole grid.
+	double field_x_min = grid_x_min;
+	double field_y_max = grid_y_max;
+
+	if(true == use_roi)
 	{
-		for(short unsigned int x = 0; x < luma.px - 1; x++, grid_x_pos += step_size)
-		{
-			// Corner vertex order: 03
-			//                      12
-			// e.g.: clockwise, as in OpenGL
-			g.vertex[0] = vertex_2(grid_x_pos, grid_y_pos);
-			g.vertex[1] = vertex_2(grid_x_pos, grid_y_pos - step_size);
-			g.vertex[2] = vertex_2(grid_x_pos + step_size, grid_y_pos - step_size);
-			g.vertex[3] = vertex_2(grid_x_pos + step_size, grid_y_pos);
+		field_x_min += roi_window.x_begin*step_size;
+		field_y_max -= roi_window.y_begin*step_size;
+	}
 
-			g.value[0] = luma.pixel_data[y*luma.px + x];
-			g.value[1] = luma.pixel_data[(y + 1)*luma.px + x];
-			g.value[2] = luma.pixel_data[(y + 1)*luma.px + (x + 1)];
-			g.value[3] = luma.pixel_data[y*luma.px + (x + 1)];
+	// Generate geometric primitives using marching squares.
 
-			size_t curr_ls_size = line_segments.size();
-			size_t curr_tris_size = triangles.size();
+	// When simplifying, each grid square's line segments are handed to the simplifier
+	// instead of being stored, and only the simplified contours are kept.
+	contour_simplifier simplifier(simplify_tolerance);
 
-			g.generate_primitives(line_segments, triangles, isovalue);
+	// When labelling, each grid square's geometry is handed to the labeler, which writes out
+	// only the geometry of components that reach the minimum area.
+	component_labeler labeler(min_area);
 
-			size_t new_ls_size = line_segments.size();
-			size_t new_tris_size = triangles.size();
+	// When merging, fully-inside grid squares are handed to the interior mesher instead.
+	interior_mesher mesher;
 
-			if (curr_ls_size != new_ls_size)
-				boundary_count++;
+	// Rows are read through the (optional) smoothing filter, just ahead of the march.
+	smoothed_rows rows(luma_pixels, luma.px, luma.py, smoothing_filter, smoothing_size, true);
 
-			if (curr_tris_size != new_tris_size)
-				interior_count++;
+	// When nothing needs the geometry itself (a plain march, the 8-bit field, or an export),
+	// the statistics are gathered during the march, as the geometry is generated, and it is
+	// never stored. Otherwise they are gathered from the stored geometry after the march.
+	const bool plain_march = 0 == simplify_tolerance && false == merge_interior && false == label_components && smoothed_rows::no_filter == smoothing_filter;
+	bool gathered_during_march = false;
+	geometry_stats stats;
 
+	cout << "Generating geometric primitives..." << endl;
+	cout << endl;
 
-		}
-	}
+	if(0 != export_filename)
+	{
+		file_sink file(export_filename);
 
+		if(false == file.is_open())
+		{
+			cout << "Failed to open export file: " << export_filename << endl;
+			return 0;
+		}
 
-	// Gather and print final information
-	double length = 0;
-	double area = 0;
-	double sa = 0;
+		stats.begin(grid_x_min, grid_y_max);
+		gathered_during_march = true;
+		tee_sink<file_sink, geometry_stats> s(file, stats);
 
-	double x_max = grid_x_min;
-	double x_min = -grid_x_min;
-	double y_max = -grid_y_max;
-	double y_min = grid_y_max;
+		if(true == byte_field)
+			march_byte_field(&byte_luma.pixel_data[0], byte_luma.px, byte_luma.py, field_x_min, field_y_max, step_size, isovalue, s, boundary_count, interior_count);
+		else
+			march_field(luma_pixels, luma.px, luma.py, field_x_min, field_y_max, step_size, isovalue, s, boundary_count, interior_count);
 
-	for(size_t i = 0; i < line_segments.size(); i++)
+		if(!file.out)
+		{
+			cout << "Failed to write export file: " << export_filename << endl;
+			return 0;
+		}
+	}
+	else if(true == progressive)
 	{
-		length += line_segments[i].length();
+		preview_printer printer;
+		printer.step_size = step_size;
 
-		if(line_segments[i].vertex[0].x > x_max)
-			x_max = line_segments[i].vertex[0].x; 
+		march_field_progressive(luma_pixels, luma.px, luma.py, field_x_min, field_y_max, step_size, isovalue, line_segments, triangles, boundary_count, interior_count, printer);
 
-		if(line_segments[i].vertex[1].x > x_max)
-			x_max = line_segments[i].vertex[1].x;
+		cout << endl;
+	}
+	else if(true == byte_field)
+	{
+		stats.begin(grid_x_min, grid_y_max);
+		gathered_during_march = true;
 
-		if(line_segments[i].vertex[0].x < x_min)
-			x_min = line_segments[i].vertex[0].x;
+		march_byte_field(&byte_luma.pixel_data[0], byte_luma.px, byte_luma.py, field_x_min, field_y_max, step_size, isovalue, stats, boundary_count, interior_count);
+	}
+	else if(true == adaptive)
+	{
+		// Refine only the tiles that straddle the isovalue.
+		if(false == have_pyramid)
+			pyramid.build(luma_pixels, luma.px, luma.py);
 
-		if(line_segments[i].vertex[1].x < x_min)
-			x_min = line_segments[i].vertex[1].x;
+		adaptive_marcher am(luma_pixels, luma.px, luma.py, pyramid, field_x_min, field_y_max, step_size);
+		am.march(line_segments, triangles, isovalue);
 
-		if(line_segments[i].vertex[0].y > y_max)
-			y_max = line_segments[i].vertex[0].y;
+		boundary_count = am.boundary_count;
+		interior_count = am.interior_count;
 
-		if(line_segments[i].vertex[1].y > y_max)
-			y_max = line_segments[i].vertex[1].y;
+		size_t num_tiles = pyramid.levels[0].tiles_x*pyramid.levels[0].tiles_y;
 
-		if(line_segments[i].vertex[0].y < y_min)
-			y_min = line_segments[i].vertex[0].y;
+		cout << "Tiles marched at pixel level: " << am.tiles_marched << " of " << num_tiles << endl;
+		cout << endl;
+	}
+	else if(true == plain_march)
+	{
+		stats.begin(grid_x_min, grid_y_max);
+		gathered_during_march = true;
+
+		march_field(luma_pixels, luma.px, luma.py, field_x_min, field_y_max, step_size, isovalue, stats, boundary_count, interior_count);
+	}
+	else
+	{
+		contour_simplifier *const wanted_simplifier = (0 != simplify_tolerance) ? &simplifier : 0;
+		interior_mesher *const wanted_mesher = (true == merge_interior) ? &mesher : 0;
+		component_labeler *const wanted_labeler = (true == label_components) ? &labeler : 0;
 
-		if(line_segments[i].vertex[1].y < y_min)
-			y_min = line_segments[i].vertex[1].y;
+		march_rows(rows, luma.px, luma.py, field_x_min, field_y_max, step_size, isovalue, wanted_simplifier, wanted_mesher, wanted_labeler, line_segments, triangles, boundary_count, interior_count);
 	}
 
-	for(size_t i = 0; i < triangles.size(); i++)
-		area += triangles[i].area();
 
-	if(0 != area)
-		sa = length/area;
+	// Gather and print final information
+	if(false == gathered_during_march)
+		stats.gather(line_segments, triangles, grid_x_min, grid_y_max);
 
 	cout << "Geometric primitive info: " << endl;
-	cout << "Vertex x min, max: " << x_min << ", " << x_max << endl;
-	cout << "Vertex y min, max: " << y_min << ", " << y_max << endl;
-	cout << "Line segments:     " << line_segments.size() << endl;
-	cout << "Length:            " << length << endl;
-	cout << "Triangles:         " << triangles.size() << endl;
-	cout << "Area:              " << area << endl;
-	cout << "Length/Area:       " << sa << endl;
-
-	cout << "Box counting dimension of boundary: " << logf(static_cast<float>(boundary_count)) / logf(1.0f / static_cast<float>(step_size)) << endl;
+
+	if(no_auto_isovalue != auto_isovalue)
+		cout << "Automatic isovalue: " << isovalue << endl;
+
+	cout << "Vertex x min, max: " << stats.x_min << ", " << stats.x_max << endl;
+	cout << "Vertex y min, max: " << stats.y_min << ", " << stats.y_max << endl;
+	cout << "Line segments:     " << stats.num_line_segments << endl;
+	cout << "Length:            " << stats.length << endl;
+	cout << "Triangles:         " << stats.num_triangles << endl;
+	cout << "Area:              " << stats.area << endl;
+	cout << "Length/Area:       " << stats.length_per_area() << endl;
+
+	cout << "Box counting dimension of boundary: " << box_counting_dimension(boundary_count, step_size) << endl;
+
+	if(true == label_components)
+	{
+		cout << endl;
+		cout << "Component info: " << endl;
+		cout << "Components kept:    " << labeler.components.size() << endl;
+		cout << "Components dropped: " << labeler.num_dropped << endl;
+
+		if(true == print_components)
+		{
+			for(size_t i = 0; i < labeler.components.size(); i++)
+			{
+				const component_stats &c = labeler.components[i];
+
+				cout << i << ": area " << c.area << ", length " << c.length;
+				cout << ", x " << c.x_min << " to " << c.x_max << ", y " << c.y_min << " to " << c.y_max << endl;
+			}
+		}
+	}
 
 	return 0;
 }
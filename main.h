@@ -4,6 +4,15 @@
 #include "image.h"
 #include "primitives.h"
 #include "marching_squares.h"
+#include "simplify.h"
+#include "interior.h"
+#include "smoothing.h"
+#include "quadtree.h"
+#include "components.h"
+#include "field_cache.h"
+#include "march.h"
+#include "server.h"
+#include "selftest.h"
 
 #include <vector>
 using std::vector;
@@ -15,9 +24,22 @@ using std::endl;
 #include <sstream>
 using std::istringstream;
 
+#include <fstream>
+using std::ifstream;
+
+#include <cmath>
+
+#include <string>
+using std::string;
+
 // Image objects and parameters.
 tga tga_texture;
 float_grayscale luma;
+byte_grayscale byte_luma;
+field_cache luma_cache;
+const float *luma_pixels = 0; // Into luma, or into the cache.
+min_max_pyramid pyramid;
+bool have_pyramid = false;
 
 double template_width = 0;
 double template_height = 0;
@@ -27,6 +49,34 @@ double inverse_width = 0;
 double grid_x_min = 0;
 double grid_y_max = 0;
 
+// Automatic isovalue, from the histogram of the image's luma.
+enum auto_isovalue_type { no_auto_isovalue, otsu_auto_isovalue, percentile_auto_isovalue };
+auto_isovalue_type auto_isovalue = no_auto_isovalue;
+double isovalue_percent = 0;
+luma_histogram histogram;
+
+// Optional processing.
+double simplify_tolerance = 0;
+bool merge_interior = false;
+smoothed_rows::filter_type smoothing_filter = smoothed_rows::no_filter;
+double smoothing_size = 0;
+bool adaptive = false;
+bool label_components = false;
+bool print_components = false;
+double min_area = 0;
+bool use_cache = false;
+bool byte_field = false;
+const char *export_filename = 0;
+bool progressive = false;
+
+// Region of interest: only the pixels covering it, and a one pixel apron, are read and marched.
+bool use_roi = false;
+bool roi_in_metres = false;
+double roi[4] = { 0, 0, 0, 0 }; // x0, y0, x1, y1: pixels, or metres right and down from (grid_x_min, grid_y_max).
+pixel_region roi_window;
+unsigned short int image_px = 0; // Of the whole image, of which luma may hold only the region.
+unsigned short int image_py = 0;
+
 // Marching squares-generated geometric primitives.
 vector<line_segment> line_segments;
 vector<triangle> triangles;
@@ -0,0 +1,309 @@
+#ifndef MARCH_H
+#define MARCH_H
+
+#include <vector>
+using std::vector;
+
+#include <cmath>
+#include <cstddef>
+
+#include "primitives.h"
+#include "marching_squares.h"
+#include "sinks.h"
+#include "smoothing.h"
+#include "simplify.h"
+#include "interior.h"
+#include "components.h"
+
+
+inline float box_counting_dimension(const size_t boundary_count, const double step_size)
+{
+	return logf(static_cast<float>(boundary_count)) / logf(1.0f / static_cast<float>(step_size));
+}
+
+// March every stride'th pixel of a float grayscale field, in both directions, so that each
+// grid square is stride pixels wide. The field is px x py pixels with the top row first,
+// with the top left pixel at (grid_x_min, grid_y_max). Pixels beyond the last whole stride,
+// at the right and bottom edges, are not marched. The geometry goes to a sink (see sinks.h).
+template<class sink>
+inline void march_field_strided(const float *const pixels, const unsigned short int px, const unsigned short int py, const size_t stride, const double grid_x_min, const double grid_y_max, const double step_size, const double isovalue, sink &s, size_t &boundary_count, size_t &interior_count)
+{
+	grid_square g;
+
+	const double strided_step_size = step_size*static_cast<double>(stride);
+	const size_t row_stride = stride*px;
+
+	double grid_x_pos = grid_x_min; // Start at minimum x.
+	double grid_y_pos = grid_y_max; // Start at maximum y.
+
+	for(size_t y = 0; y + stride < py; y += stride, grid_y_pos -= strided_step_size, grid_x_pos = grid_x_min)
+	{
+		const float *top_row = pixels + y*px;
+		const float *bottom_row = top_row + row_stride;
+
+		for(size_t x = 0; x + stride < px; x += stride, grid_x_pos += strided_step_size)
+		{
+			// Corner vertex order: 03
+			//                      12
+			// e.g.: clockwise, as in OpenGL
+			g.vertex[0] = vertex_2(grid_x_pos, grid_y_pos);
+			g.vertex[1] = vertex_2(grid_x_pos, grid_y_pos - strided_step_size);
+			g.vertex[2] = vertex_2(grid_x_pos + strided_step_size, grid_y_pos - strided_step_size);
+			g.vertex[3] = vertex_2(grid_x_pos + strided_step_size, grid_y_pos);
+
+			g.value[0] = top_row[x];
+			g.value[1] = bottom_row[x];
+			g.value[2] = bottom_row[x + stride];
+			g.value[3] = top_row[x + stride];
+
+			const unsigned short int mask = g.case_index(isovalue);
+
+			g.generate(mask, s, isovalue);
+
+			if(0 != marching_squares_cases[mask].num_line_segments)
+				boundary_count++;
+
+			if(0 != marching_squares_cases[mask].num_triangles)
+				interior_count++;
+		}
+	}
+}
+
+// March a whole float grayscale field: march_field_strided() with a stride of 1.
+// This is the plain march that main() performs when no options are given, and produces
+// the same geometry, in the same order.
+template<class sink>
+inline void march_field(const float *const pixels, const unsigned short int px, const unsigned short int py, const double grid_x_min, const double grid_y_max, const double step_size, const double isovalue, sink &s, size_t &boundary_count, size_t &interior_count)
+{
+	march_field_strided(pixels, px, py, 1, grid_x_min, grid_y_max, step_size, isovalue, s, boundary_count, interior_count);
+}
+
+inline void march_field(const float *const pixels, const unsigned short int px, const unsigned short int py, const double grid_x_min, const double grid_y_max, const double step_size, const double isovalue, vector<line_segment> &line_segments, vector<triangle> &triangles, size_t &boundary_count, size_t &interior_count)
+{
+	vector_sink<> s(line_segments, triangles);
+	march_field(pixels, px, py, grid_x_min, grid_y_max, step_size, isovalue, s, boundary_count, interior_count);
+}
+
+// Coarse-to-fine march, for previews: the field is marched at strides of
+// progressive_max_stride, ..., 4, 2, and then 1. Each level's geometry and statistics are handed to
+// receiver.level(stride, line_segments, triangles, stats, boundary_count, interior_count)
+// as soon as that level completes. A level costs about 1/stride^2 of the full march.
+// Strides that leave the field less than one grid square wide or high are skipped.
+// The last level is march_field() itself, and its geometry is left in line_segments and triangles.
+const size_t progressive_max_stride = 8;
+
+template<class receiver>
+inline void march_field_progressive(const float *const pixels, const unsigned short int px, const unsigned short int py, const double grid_x_min, const double grid_y_max, const double step_size, const double isovalue, vector<line_segment> &line_segments, vector<triangle> &triangles, size_t &boundary_count, size_t &interior_count, receiver &r)
+{
+	for(size_t stride = progressive_max_stride; 1 <= stride; stride /= 2)
+	{
+		if(stride >= px || stride >= py)
+			continue;
+
+		line_segments.clear();
+		triangles.clear();
+		boundary_count = 0;
+		interior_count = 0;
+
+		geometry_stats stats;
+		stats.begin(grid_x_min, grid_y_max);
+
+		vector_sink<> vectors(line_segments, triangles);
+		tee_sink<vector_sink<>, geometry_stats> s(vectors, stats);
+
+		march_field_strided(pixels, px, py, stride, grid_x_min, grid_y_max, step_size, isovalue, s, boundary_count, interior_count);
+
+		r.level(stride, line_segments, triangles, stats, boundary_count, interior_count);
+	}
+}
+
+// March a float grayscale field one row at a time, as main() does for the options that
+// work on each grid square's geometry. Rows are read through rows (see smoothing.h).
+// Each of these is optional (null to leave it out):
+// simplifier: the contour line segments go to the simplifier, and only the simplified contours are kept.
+// mesher:     fully-inside grid squares are merged into rectangles instead of triangulated.
+// labeler:    all geometry goes to the component labeler, which writes out only the geometry
+//             of the components that reach its minimum area. Not combined with the other two.
+inline void march_rows(smoothed_rows &rows, const unsigned short int px, const unsigned short int py, const double grid_x_min, const double grid_y_max, const double step_size, const double isovalue, contour_simplifier *const simplifier, interior_mesher *const mesher, component_labeler *const labeler, vector<line_segment> &line_segments, vector<triangle> &triangles, size_t &boundary_count, size_t &interior_count)
+{
+	grid_square g;
+
+	// Each grid square's geometry is collected here first, for whichever of these wants it.
+	vector<line_segment> cell_line_segments;
+	vector<line_segment> &march_line_segments = (0 != simplifier || 0 != labeler) ? cell_line_segments : line_segments;
+	vector<triangle> cell_triangles;
+	vector<triangle> &march_triangles = (0 != labeler) ? cell_triangles : triangles;
+	vector_sink<> s(march_line_segments, march_triangles);
+
+	double grid_x_pos = grid_x_min; // Start at minimum x.
+	double grid_y_pos = grid_y_max; // Start at maximum y.
+
+	for(short unsigned int y = 0; y < py - 1; y++, grid_y_pos -= step_size, grid_x_pos = grid_x_min)
+	{
+		const float *top_row = rows.row(y);
+		const float *bottom_row = rows.row(y + 1);
+
+		if(0 != labeler)
+		{
+			if(0 == y)
+				labeler->label_row(top_row, px, isovalue);
+
+			labeler->label_row(bottom_row, px, isovalue);
+		}
+
+		for(short unsigned int x = 0; x < px - 1; x++, grid_x_pos += step_size)
+		{
+			// Corner vertex order: 03
+			//                      12
+			// e.g.: clockwise, as in OpenGL
+			g.vertex[0] = vertex_2(grid_x_pos, grid_y_pos);
+			g.vertex[1] = vertex_2(grid_x_pos, grid_y_pos - step_size);
+			g.vertex[2] = vertex_2(grid_x_pos + step_size, grid_y_pos - step_size);
+			g.vertex[3] = vertex_2(grid_x_pos + step_size, grid_y_pos);
+
+			g.value[0] = top_row[x];
+			g.value[1] = bottom_row[x];
+			g.value[2] = bottom_row[x + 1];
+			g.value[3] = top_row[x + 1];
+
+			const unsigned short int mask = g.case_index(isovalue);
+
+			if(0 != marching_squares_cases[mask].num_line_segments)
+				boundary_count++;
+
+			if(0 != marching_squares_cases[mask].num_triangles)
+				interior_count++;
+
+			if(0 != mesher && 15 == mask)
+			{
+				mesher->add(g, x);
+				continue;
+			}
+
+			g.generate(mask, s, isovalue);
+
+			if(0 != labeler)
+			{
+				labeler->add(x, mask, cell_line_segments.data(), cell_triangles.data(), line_segments, triangles);
+
+				cell_line_segments.clear();
+				cell_triangles.clear();
+			}
+			else if(0 != simplifier)
+			{
+				for(size_t i = 0; i < cell_line_segments.size(); i++)
+					simplifier->add(cell_line_segments[i], line_segments);
+
+				cell_line_segments.clear();
+			}
+		}
+
+		if(0 != labeler)
+			labeler->end_row(line_segments, triangles);
+
+		if(0 != simplifier)
+			simplifier->end_row(grid_y_pos - step_size, line_segments);
+
+		if(0 != mesher)
+			mesher->end_row(grid_y_pos, grid_y_pos - step_size, triangles);
+	}
+
+	if(0 != simplifier)
+		simplifier->flush(line_segments);
+
+	if(0 != mesher)
+		mesher->flush(triangles);
+
+	if(0 != labeler)
+		labeler->flush(line_segments, triangles);
+}
+
+// The smallest 8-bit value whose field value (value/255.0f) is inside the isosurface,
+// or 256 if there is none. A byte is inside if and only if it is >= this threshold,
+// so cells can be classified with integer compares alone.
+inline unsigned short int byte_threshold(const double isovalue)
+{
+	unsigned short int threshold = 0;
+
+	while(256 > threshold && static_cast<double>(static_cast<float>(threshold)/255.0f) < isovalue)
+		threshold++;
+
+	return threshold;
+}
+
+// Classify one row of 8-bit pixels: inside[x] = 1 if pixels[x] is inside the isosurface.
+// Branch-free, so that the compiler can vectorize it.
+inline void classify_byte_row(const unsigned char *const pixels, const size_t px, const unsigned short int threshold, unsigned char *const inside)
+{
+	for(size_t x = 0; x < px; x++)
+		inside[x] = static_cast<unsigned char>(pixels[x] >= threshold);
+}
+
+// Combine two classified rows into the case index of each grid square between them.
+inline void byte_row_case_indices(const unsigned char *const top_inside, const unsigned char *const bottom_inside, const size_t px, unsigned char *const masks)
+{
+	for(size_t x = 0; x < px - 1; x++)
+		masks[x] = static_cast<unsigned char>(top_inside[x] | bottom_inside[x] << 1 | bottom_inside[x + 1] << 2 | top_inside[x + 1] << 3);
+}
+
+// March an 8-bit grayscale field, as march_field() does for a float field.
+// Grid squares are classified a row at a time by integer compares against byte_threshold();
+// pixels are converted to float only for the grid squares that produce geometry.
+template<class sink>
+inline void march_byte_field(const unsigned char *const pixels, const unsigned short int px, const unsigned short int py, const double grid_x_min, const double grid_y_max, const double step_size, const double isovalue, sink &s, size_t &boundary_count, size_t &interior_count)
+{
+	const unsigned short int threshold = byte_threshold(isovalue);
+
+	vector<unsigned char> top_inside(px), bottom_inside(px), masks(px);
+
+	classify_byte_row(pixels, px, threshold, &top_inside[0]);
+
+	grid_square g;
+
+	double grid_x_pos = grid_x_min; // Start at minimum x.
+	double grid_y_pos = grid_y_max; // Start at maximum y.
+
+	for(short unsigned int y = 0; y < py - 1; y++, grid_y_pos -= step_size, grid_x_pos = grid_x_min)
+	{
+		const unsigned char *top_row = pixels + static_cast<size_t>(y)*px;
+		const unsigned char *bottom_row = top_row + px;
+
+		classify_byte_row(bottom_row, px, threshold, &bottom_inside[0]);
+		byte_row_case_indices(&top_inside[0], &bottom_inside[0], px, &masks[0]);
+
+		for(short unsigned int x = 0; x < px - 1; x++, grid_x_pos += step_size)
+		{
+			// Wholly outside; no geometry.
+			if(0 == masks[x])
+				continue;
+
+			g.vertex[0] = vertex_2(grid_x_pos, grid_y_pos);
+			g.vertex[1] = vertex_2(grid_x_pos, grid_y_pos - step_size);
+			g.vertex[2] = vertex_2(grid_x_pos + step_size, grid_y_pos - step_size);
+			g.vertex[3] = vertex_2(grid_x_pos + step_size, grid_y_pos);
+
+			g.value[0] = static_cast<float>(top_row[x])/255.0f;
+			g.value[1] = static_cast<float>(bottom_row[x])/255.0f;
+			g.value[2] = static_cast<float>(bottom_row[x + 1])/255.0f;
+			g.value[3] = static_cast<float>(top_row[x + 1])/255.0f;
+
+			g.generate(masks[x], s, isovalue);
+
+			if(0 != marching_squares_cases[masks[x]].num_line_segments)
+				boundary_count++;
+
+			if(0 != marching_squares_cases[masks[x]].num_triangles)
+				interior_count++;
+		}
+
+		top_inside.swap(bottom_inside);
+	}
+}
+
+inline void march_byte_field(const unsigned char *const pixels, const unsigned short int px, const unsigned short int py, const double grid_x_min, const double grid_y_max, const double step_size, const double isovalue, vector<line_segment> &line_segments, vector<triangle> &triangles, size_t &boundary_count, size_t &interior_count)
+{
+	vector_sink<> s(line_segments, triangles);
+	march_byte_field(pixels, px, py, grid_x_min, grid_y_max, step_size, isovalue, s, boundary_count, interior_count);
+}
+
+#endif
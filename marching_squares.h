@@ -4,494 +4,213 @@
 #include <vector>
 using std::vector;
 
+#include <cstddef>
+
 #include "primitives.h"
+#include "sinks.h"
 
-class grid_square
+
+// Corner vertex order: 03
+//                      12
+// e.g.: clockwise, as in OpenGL
+//
+// Point indices used by the case tables:
+// 0 - 3: the corner vertices.
+// 4 - 7: the isovalue crossings on edges 0 - 3, where edge k joins corner k and corner (k + 1) % 4.
+
+// Triangles and image edge line segments for each of the 16 cases,
+// as indices into the 8 points above.
+class marching_squares_case
 {
 public:
-	vertex_2 vertex[4];
-	double value[4];
+	unsigned char num_triangles;
+	unsigned char triangles[3][3]; // Max three triangles per grid square.
+	unsigned char num_line_segments;
+	unsigned char line_segments[2][2]; // Max two image edge line segments per grid square.
+};
 
-	inline vertex_2 vertex_interp(const vertex_2 &p1, const vertex_2 &p2, const double v1, const double v2, const double isovalue)
-	{
-		static vertex_2 temp;
-		static double mu;
+constexpr marching_squares_case marching_squares_cases[16] =
+{
+	// 0: all outside of image area, no geometry.
+	{ 0, { { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 } }, 0, { { 0, 0 }, { 0, 0 } } },
+	// 1:  10
+	//     00
+	{ 1, { { 0, 4, 7 }, { 0, 0, 0 }, { 0, 0, 0 } }, 1, { { 4, 7 }, { 0, 0 } } },
+	// 2:  00
+	//     10
+	{ 1, { { 4, 1, 5 }, { 0, 0, 0 }, { 0, 0, 0 } }, 1, { { 4, 5 }, { 0, 0 } } },
+	// 3:  10
+	//     10
+	{ 2, { { 0, 1, 7 }, { 7, 1, 5 }, { 0, 0, 0 } }, 1, { { 7, 5 }, { 0, 0 } } },
+	// 4:  00
+	//     01
+	{ 1, { { 5, 2, 6 }, { 0, 0, 0 }, { 0, 0, 0 } }, 1, { { 5, 6 }, { 0, 0 } } },
+	// 5:  10
+	//     01
+	{ 2, { { 0, 4, 7 }, { 5, 2, 6 }, { 0, 0, 0 } }, 2, { { 4, 7 }, { 5, 6 } } },
+	// 6:  00
+	//     11
+	{ 2, { { 4, 1, 6 }, { 6, 1, 2 }, { 0, 0, 0 } }, 1, { { 4, 6 }, { 0, 0 } } },
+	// 7:  10
+	//     11
+	{ 3, { { 0, 1, 7 }, { 7, 1, 6 }, { 6, 1, 2 } }, 1, { { 7, 6 }, { 0, 0 } } },
+	// 8:  01
+	//     00
+	{ 1, { { 7, 6, 3 }, { 0, 0, 0 }, { 0, 0, 0 } }, 1, { { 7, 6 }, { 0, 0 } } },
+	// 9:  11
+	//     00
+	{ 2, { { 0, 4, 3 }, { 3, 4, 6 }, { 0, 0, 0 } }, 1, { { 4, 6 }, { 0, 0 } } },
+	// 10: 01
+	//     10
+	{ 2, { { 4, 1, 5 }, { 7, 6, 3 }, { 0, 0, 0 } }, 2, { { 4, 5 }, { 7, 6 } } },
+	// 11: 11
+	//     10
+	{ 3, { { 0, 1, 5 }, { 0, 5, 6 }, { 0, 6, 3 } }, 1, { { 5, 6 }, { 0, 0 } } },
+	// 12: 01
+	//     01
+	{ 2, { { 7, 5, 3 }, { 3, 5, 2 }, { 0, 0, 0 } }, 1, { { 7, 5 }, { 0, 0 } } },
+	// 13: 11
+	//     01
+	{ 3, { { 0, 4, 3 }, { 3, 4, 5 }, { 3, 5, 2 } }, 1, { { 4, 5 }, { 0, 0 } } },
+	// 14: 01
+	//     11
+	{ 3, { { 4, 1, 2 }, { 4, 2, 7 }, { 7, 2, 3 } }, 1, { { 4, 7 }, { 0, 0 } } },
+	// 15: all inside of image area, no outlines.
+	{ 2, { { 0, 1, 3 }, { 3, 1, 2 }, { 0, 0, 0 } }, 0, { { 0, 0 }, { 0, 0 } } }
+};
 
-		// http://local.wasp.uwa.edu.au/~pbourke/geometry/polygonise/
-		mu = (isovalue - v1)/(v2 - v1);
-		temp.x = p1.x + mu*(p2.x - p1.x);
-		temp.y = p1.y + mu*(p2.y - p1.y);
+// The edges crossed by the isovalue in each case: those whose two corners differ.
+// Crossings are always interpolated from the inside corner towards the outside corner.
+class marching_squares_edges
+{
+public:
+	unsigned char num_edges[16];
+	unsigned char edges[16][4];
+	unsigned char inside_corner[16][4];
+	unsigned char outside_corner[16][4];
+};
 
-		return temp;
-	}
+constexpr marching_squares_edges make_marching_squares_edges(void)
+{
+	marching_squares_edges e = {};
 
-	inline void generate_primitives(vector<line_segment> &line_segments, vector<triangle> &triangles, const double isovalue)
+	for(unsigned int mask = 0; mask < 16; mask++)
 	{
-		// Identify which of the 4 corners of the square are within the isosurface.
-		// Max 16 cases. Only 14 cases produce triangles and image edge line segments.
-
-		// Corner vertex order: 03
-		//                      12
-		// e.g.: clockwise, as in OpenGL
-
-		unsigned short int mask = 0;
-
-		if(value[0] >= isovalue) 
-			mask |= 1;
-
-		if(value[1] >= isovalue)
-			mask |= 2;
-
-		if(value[2] >= isovalue)
-			mask |= 4;
-
-		if(value[3] >= isovalue)
-			mask |= 8;
-
-		// Max 6 vertices per grid cube.
-		static vertex_2 a, b, c, d, e, f;
-		
-		// Max three triangles per grid cube.
-		static triangle t;
-
-		// Max two image edge line segments per grid cube.
-		static line_segment ls;
-
-		// Handle the 16 cases manually.
-		switch(mask)
+		for(unsigned int k = 0; k < 4; k++)
 		{
-			case 1:
-			{
-				//1:
-				//10
-				//00
-
-				a = vertex[0];
-				b = vertex_interp(vertex[0], vertex[1], value[0], value[1], isovalue);
-				c = vertex_interp(vertex[0], vertex[3], value[0], value[3], isovalue);
-
-				t.vertex[0] = a;
-				t.vertex[1] = b;
-				t.vertex[2] = c;
+			const unsigned int j = (k + 1) % 4;
 
-				ls.vertex[0] = b;
-				ls.vertex[1] = c;
+			if(((mask >> k) & 1) == ((mask >> j) & 1))
+				continue;
 
-				triangles.push_back(t);
-				line_segments.push_back(ls);
+			const unsigned int n = e.num_edges[mask]++;
 
-				break;
-			}
-			case 2:
-			{
-				//2:
-				//00
-				//10
-
-				a = vertex_interp(vertex[1], vertex[0], value[1], value[0], isovalue);
-				b = vertex[1];
-				c = vertex_interp(vertex[1], vertex[2], value[1], value[2], isovalue);
-
-				t.vertex[0] = a;
-				t.vertex[1] = b;
-				t.vertex[2] = c;
-				triangles.push_back(t);
-
-				ls.vertex[0] = a;
-				ls.vertex[1] = c;
-				line_segments.push_back(ls);
+			e.edges[mask][n] = static_cast<unsigned char>(k);
+			e.inside_corner[mask][n] = static_cast<unsigned char>(((mask >> k) & 1) ? k : j);
+			e.outside_corner[mask][n] = static_cast<unsigned char>(((mask >> k) & 1) ? j : k);
+		}
+	}
 
-				break;
-			}
-			case 4:
-			{
-				//4:
-				//00
-				//01
+	return e;
+}
 
-				a = vertex_interp(vertex[2], vertex[1], value[2], value[1], isovalue);
-				b = vertex[2];
-				c = vertex_interp(vertex[2], vertex[3], value[2], value[3], isovalue);
+constexpr marching_squares_edges marching_squares_crossed_edges = make_marching_squares_edges();
 
-				t.vertex[0] = a;
-				t.vertex[1] = b;
-				t.vertex[2] = c;
-				triangles.push_back(t);
 
-				ls.vertex[0] = a;
-				ls.vertex[1] = c;
-				line_segments.push_back(ls);
+class grid_square
+{
+public:
+	vertex_2 vertex[4];
+	double value[4];
 
-				break;
-			}
-			case 8:
-			{
-				//8:
-				//01
-				//00
+	inline vertex_2 vertex_interp(const vertex_2 &p1, const vertex_2 &p2, const double v1, const double v2, const double isovalue) const
+	{
+		// http://local.wasp.uwa.edu.au/~pbourke/geometry/polygonise/
+		const double mu = (isovalue - v1)/(v2 - v1);
 
-				a = vertex_interp(vertex[3], vertex[0], value[3], value[0], isovalue);
-				b = vertex_interp(vertex[3], vertex[2], value[3], value[2], isovalue);
-				c = vertex[3];
+		return vertex_2(p1.x + mu*(p2.x - p1.x), p1.y + mu*(p2.y - p1.y));
+	}
 
-				t.vertex[0] = a;
-				t.vertex[1] = b;
-				t.vertex[2] = c;
-				triangles.push_back(t);
+	inline unsigned short int case_index(const double isovalue) const
+	{
+		// Identify which of the 4 corners of the square are within the isosurface.
+		// Max 16 cases. Only 14 cases produce triangles and image edge line segments.
+		return	  static_cast<unsigned short int>(value[0] >= isovalue)\
+				| static_cast<unsigned short int>(value[1] >= isovalue) << 1\
+				| static_cast<unsigned short int>(value[2] >= isovalue) << 2\
+				| static_cast<unsigned short int>(value[3] >= isovalue) << 3;
+	}
 
-				ls.vertex[0] = a;
-				ls.vertex[1] = b;
-				line_segments.push_back(ls);
+	// Emit the geometry for this grid square from the case tables, into a sink (see sinks.h).
+	// Case 0, the commonest case in most images, returns at once; otherwise the only
+	// data-dependent branches are the loops over the (0, 2 or 4) crossed edges and over the
+	// case's triangles and line segments. Outputs that the sink does not want are compiled out.
+	template<class sink>
+	inline void generate(sink &s, const double isovalue) const
+	{
+		generate(case_index(isovalue), s, isovalue);
+	}
 
-				break;
-			}
+	// As above, for a case index that the caller has already classified;
+	// it must equal case_index(isovalue).
+	template<class sink>
+	inline void generate(const unsigned short int mask, sink &s, const double isovalue) const
+	{
+		if((false == sink::wants_line_segments && false == sink::wants_triangles) || 0 == mask)
+			return;
 
+		const marching_squares_case &c = marching_squares_cases[mask];
+		const marching_squares_edges &e = marching_squares_crossed_edges;
 
-			case 3:
-			{
-				//3:
-				//10
-				//10
-
-				a = vertex[0];
-				b = vertex[1];
-				c = vertex_interp(vertex[1], vertex[2], value[1], value[2], isovalue);
-				d = vertex_interp(vertex[0], vertex[3], value[0], value[3], isovalue);
-
-				t.vertex[0] = a;
-				t.vertex[1] = b;
-				t.vertex[2] = d;
-				triangles.push_back(t);
-
-				t.vertex[0] = d;
-				t.vertex[1] = b;
-				t.vertex[2] = c;
-				triangles.push_back(t);
-
-				ls.vertex[0] = d;
-				ls.vertex[1] = c;
-				line_segments.push_back(ls);
-
-				break;
-			}
-			case 6:
-			{
-				//6:
-				//00
-				//11
-
-				a = vertex_interp(vertex[1], vertex[0], value[1], value[0], isovalue);
-				b = vertex[1];
-				c = vertex[2];
-				d = vertex_interp(vertex[2], vertex[3], value[2], value[3], isovalue);
-
-				t.vertex[0] = a;
-				t.vertex[1] = b;
-				t.vertex[2] = d;
-				triangles.push_back(t);
-
-				t.vertex[0] = d;
-				t.vertex[1] = b;
-				t.vertex[2] = c;
-				triangles.push_back(t);
-
-				ls.vertex[0] = a;
-				ls.vertex[1] = d;
-				line_segments.push_back(ls);
-
-				break;
-			}
-			case 9:
-			{
-				//9:
-				//11
-				//00
-
-				a = vertex[0];
-				b = vertex_interp(vertex[0], vertex[1], value[0], value[1], isovalue);
-				c = vertex_interp(vertex[3], vertex[2], value[3], value[2], isovalue);
-				d = vertex[3];
-
-				t.vertex[0] = a;
-				t.vertex[1] = b;
-				t.vertex[2] = d;
-				triangles.push_back(t);
-
-				t.vertex[0] = d;
-				t.vertex[1] = b;
-				t.vertex[2] = c;
-				triangles.push_back(t);
-
-				ls.vertex[0] = b;
-				ls.vertex[1] = c;
-				line_segments.push_back(ls);
-
-				break;
-			}
-			case 12:
-			{
-				//12:
-				//01
-				//01
-
-				a = vertex_interp(vertex[3], vertex[0], value[3], value[0], isovalue);
-				b = vertex_interp(vertex[2], vertex[1], value[2], value[1], isovalue);
-				c = vertex[2];
-				d = vertex[3];
-
-				t.vertex[0] = a;
-				t.vertex[1] = b;
-				t.vertex[2] = d;
-				triangles.push_back(t);
-
-				t.vertex[0] = d;
-				t.vertex[1] = b;
-				t.vertex[2] = c;
-				triangles.push_back(t);
-
-				ls.vertex[0] = a;
-				ls.vertex[1] = b;
-				line_segments.push_back(ls);
-
-				break;
-			}
+		vertex_2 points[8];
 
+		if(true == sink::wants_triangles)
+		{
+			points[0] = vertex[0];
+			points[1] = vertex[1];
+			points[2] = vertex[2];
+			points[3] = vertex[3];
+		}
 
-			case 5:
-			{
-				//5:
-				//10
-				//01
-
-				a = vertex[0];
-				b = vertex_interp(vertex[0], vertex[1], value[0], value[1], isovalue);
-				c = vertex_interp(vertex[0], vertex[3], value[0], value[3], isovalue);
-				d = vertex_interp(vertex[2], vertex[1], value[2], value[1], isovalue);
-				e = vertex[2];
-				f = vertex_interp(vertex[2], vertex[3], value[2], value[3], isovalue);
-
-				t.vertex[0] = a;
-				t.vertex[1] = b;
-				t.vertex[2] = c;
-				triangles.push_back(t);
-
-				t.vertex[0] = d;
-				t.vertex[1] = e;
-				t.vertex[2] = f;
-				triangles.push_back(t);
-
-				ls.vertex[0] = b;
-				ls.vertex[1] = c;
-				line_segments.push_back(ls);
-
-				ls.vertex[0] = d;
-				ls.vertex[1] = f;
-				line_segments.push_back(ls);
-
-				break;
-			}
-			case 10:
-			{
-				//10:
-				//01
-				//10
-
-				a = vertex_interp(vertex[1], vertex[0], value[1], value[0], isovalue);
-				b = vertex[1];
-				c = vertex_interp(vertex[1], vertex[2], value[1], value[2], isovalue);
-				d = vertex_interp(vertex[3], vertex[0], value[3], value[0], isovalue);
-				e = vertex_interp(vertex[3], vertex[2], value[3], value[2], isovalue);
-				f = vertex[3];
-
-				t.vertex[0] = a;
-				t.vertex[1] = b;
-				t.vertex[2] = c;
-				triangles.push_back(t);
-
-				t.vertex[0] = d;
-				t.vertex[1] = e;
-				t.vertex[2] = f;
-				triangles.push_back(t);
-
-				ls.vertex[0] = a;
-				ls.vertex[1] = c;
-				line_segments.push_back(ls);
-
-				ls.vertex[0] = d;
-				ls.vertex[1] = e;
-				line_segments.push_back(ls);
-
-				break;
-			}
+		for(size_t i = 0; i < e.num_edges[mask]; i++)
+		{
+			const unsigned char in = e.inside_corner[mask][i];
+			const unsigned char out = e.outside_corner[mask][i];
 
+			points[4 + e.edges[mask][i]] = vertex_interp(vertex[in], vertex[out], value[in], value[out], isovalue);
+		}
 
-			case 7:
-			{
-				//7:
-				//10
-				//11
-
-				a = vertex[0];
-				b = vertex[1];
-				c = vertex[2];
-				d = vertex_interp(vertex[2], vertex[3], value[2], value[3], isovalue);
-				e = vertex_interp(vertex[0], vertex[3], value[0], value[3], isovalue);
-
-				t.vertex[0] = a;
-				t.vertex[1] = b;
-				t.vertex[2] = e;
-				triangles.push_back(t);
-
-				t.vertex[0] = e;
-				t.vertex[1] = b;
-				t.vertex[2] = d;
-				triangles.push_back(t);
-
-				t.vertex[0] = d;
-				t.vertex[1] = b;
-				t.vertex[2] = c;
-				triangles.push_back(t);
-
-				ls.vertex[0] = e;
-				ls.vertex[1] = d;
-				line_segments.push_back(ls);
-
-				break;
-			}
-			case 11:
-			{
-				//11:
-				//11
-				//10
-
-				a = vertex[0];
-				b = vertex[1];
-				c = vertex_interp(vertex[1], vertex[2], value[1], value[2], isovalue);
-				d = vertex_interp(vertex[3], vertex[2], value[3], value[2], isovalue);
-				e = vertex[3];
-
-				t.vertex[0] = a;
-				t.vertex[1] = b;
-				t.vertex[2] = c;
-				triangles.push_back(t);
-
-				t.vertex[0] = a;
-				t.vertex[1] = c;
-				t.vertex[2] = d;
-				triangles.push_back(t);
-
-				t.vertex[0] = a;
-				t.vertex[1] = d;
-				t.vertex[2] = e;
-				triangles.push_back(t);
-
-				ls.vertex[0] = c;
-				ls.vertex[1] = d;
-				line_segments.push_back(ls);
-
-				break;
-			}
-			case 13:
-			{
-				//13:
-				//11
-				//01
-
-				a = vertex[0];
-				b = vertex_interp(vertex[0], vertex[1], value[0], value[1], isovalue);
-				c = vertex_interp(vertex[2], vertex[1], value[2], value[1], isovalue);
-				d = vertex[2];
-				e = vertex[3];
-
-				t.vertex[0] = a;
-				t.vertex[1] = b;
-				t.vertex[2] = e;
-				triangles.push_back(t);
-
-				t.vertex[0] = e;
-				t.vertex[1] = b;
-				t.vertex[2] = c;
-				triangles.push_back(t);
-
-				t.vertex[0] = e;
-				t.vertex[1] = c;
-				t.vertex[2] = d;
-				triangles.push_back(t);
-
-				ls.vertex[0] = b;
-				ls.vertex[1] = c;
-				line_segments.push_back(ls);
-
-				break;
-			}
-			case 14:
-			{
-				//14:
-				//01
-				//11
-
-				a = vertex_interp(vertex[1], vertex[0], value[1], value[0], isovalue);
-				b = vertex[1];
-				c = vertex[2];
-				d = vertex[3];
-				e = vertex_interp(vertex[3], vertex[0], value[3], value[0], isovalue);
-
-				t.vertex[0] = a;
-				t.vertex[1] = b;
-				t.vertex[2] = c;
-				triangles.push_back(t);
-
-				t.vertex[0] = a;
-				t.vertex[1] = c;
-				t.vertex[2] = e;
-				triangles.push_back(t);
-
-				t.vertex[0] = e;
-				t.vertex[1] = c;
-				t.vertex[2] = d;
-				triangles.push_back(t);
-
-				ls.vertex[0] = a;
-				ls.vertex[1] = e;
-				line_segments.push_back(ls);
-
-				break;
-			}
+		if(true == sink::wants_triangles)
+		{
+			triangle t;
 
-			case 15:
+			for(size_t i = 0; i < c.num_triangles; i++)
 			{
-				// Case 15 (all inside of image area) produces no outlines.
-
-				//15:
-				//11
-				//11
-
-				t.vertex[0] = vertex[0];
-				t.vertex[1] = vertex[1];
-				t.vertex[2] = vertex[3];
-				triangles.push_back(t);
-
-				t.vertex[0] = vertex[3];
-				t.vertex[1] = vertex[1];
-				t.vertex[2] = vertex[2];
-				triangles.push_back(t);
-
-				break;
+				t.vertex[0] = points[c.triangles[i][0]];
+				t.vertex[1] = points[c.triangles[i][1]];
+				t.vertex[2] = points[c.triangles[i][2]];
+				s.add(t);
 			}
+		}
 
+		if(true == sink::wants_line_segments)
+		{
+			line_segment ls;
 
-			default:
+			for(size_t i = 0; i < c.num_line_segments; i++)
 			{
-				// Case 0 (all outside of image area) produces no geometry.
-
-				//0:
-				//00
-				//00
-
-				break;
+				ls.vertex[0] = points[c.line_segments[i][0]];
+				ls.vertex[1] = points[c.line_segments[i][1]];
+				s.add(ls);
 			}
 		}
 	}
+
+	inline void generate_primitives(vector<line_segment> &line_segments, vector<triangle> &triangles, const double isovalue) const
+	{
+		vector_sink<> s(line_segments, triangles);
+		generate(s, isovalue);
+	}
 };
 
 #endif
@@ -70,7 +70,7 @@ class triangle
 public:
 	vertex_2 vertex[3];
 
-	inline double area(void)
+	inline double area(void) const
 	{
 		if(vertex[0] == vertex[1] || vertex[0] == vertex[2] || vertex[1] == vertex[2])
 			return 0;
@@ -87,7 +87,7 @@ class line_segment
 public:
 	vertex_2 vertex[2];
 
-	double length(void)
+	double length(void) const
 	{
 		return sqrt( pow(vertex[0].x - vertex[1].x, 2.0) + pow(vertex[0].y - vertex[1].y, 2.0) );
 	}
@@ -0,0 +1,287 @@
+#ifndef QUADTREE_H
+#define QUADTREE_H
+
+#include <vector>
+using std::vector;
+
+#include <cstddef>
+
+#include "primitives.h"
+#include "marching_squares.h"
+
+
+// Min/max summaries of a float grayscale image over square tiles of grid squares.
+// Level 0 tiles are base_tile_size x base_tile_size grid squares, and each level
+// above combines 2 x 2 tiles of the level below, up to a single tile.
+// A tile's range covers every pixel on its grid squares' corners, including the
+// pixels on the edges it shares with its neighbours.
+class min_max_pyramid
+{
+public:
+	static const size_t base_tile_size = 8;
+
+	class level
+	{
+	public:
+		size_t tiles_x;
+		size_t tiles_y;
+		size_t tile_size; // In grid squares.
+		vector<float> min_values;
+		vector<float> max_values;
+	};
+
+	vector<level> levels;
+
+	void build(const float *const pixels, const unsigned short int px, const unsigned short int py)
+	{
+		levels.clear();
+
+		if(px < 2 || py < 2)
+			return;
+
+		const size_t cells_x = px - 1;
+		const size_t cells_y = py - 1;
+
+		level base;
+		base.tile_size = base_tile_size;
+		base.tiles_x = (cells_x + base_tile_size - 1)/base_tile_size;
+		base.tiles_y = (cells_y + base_tile_size - 1)/base_tile_size;
+		base.min_values.resize(base.tiles_x*base.tiles_y);
+		base.max_values.resize(base.tiles_x*base.tiles_y);
+
+		for(size_t ty = 0; ty < base.tiles_y; ty++)
+		{
+			size_t y_begin = ty*base_tile_size;
+			size_t y_end = y_begin + base_tile_size;
+
+			if(y_end > cells_y)
+				y_end = cells_y;
+
+			for(size_t tx = 0; tx < base.tiles_x; tx++)
+			{
+				size_t x_begin = tx*base_tile_size;
+				size_t x_end = x_begin + base_tile_size;
+
+				if(x_end > cells_x)
+					x_end = cells_x;
+
+				float min_value = pixels[y_begin*px + x_begin];
+				float max_value = min_value;
+
+				// Pixels x_begin ... x_end and y_begin ... y_end inclusive.
+				for(size_t y = y_begin; y <= y_end; y++)
+				{
+					for(size_t x = x_begin; x <= x_end; x++)
+					{
+						float v = pixels[y*px + x];
+
+						if(v < min_value)
+							min_value = v;
+
+						if(v > max_value)
+							max_value = v;
+					}
+				}
+
+				base.min_values[ty*base.tiles_x + tx] = min_value;
+				base.max_values[ty*base.tiles_x + tx] = max_value;
+			}
+		}
+
+		levels.push_back(base);
+
+		while(levels.back().tiles_x > 1 || levels.back().tiles_y > 1)
+		{
+			const level &below = levels.back();
+
+			level above;
+			above.tile_size = below.tile_size*2;
+			above.tiles_x = (below.tiles_x + 1)/2;
+			above.tiles_y = (below.tiles_y + 1)/2;
+			above.min_values.resize(above.tiles_x*above.tiles_y);
+			above.max_values.resize(above.tiles_x*above.tiles_y);
+
+			for(size_t ty = 0; ty < above.tiles_y; ty++)
+			{
+				for(size_t tx = 0; tx < above.tiles_x; tx++)
+				{
+					size_t first = (2*ty)*below.tiles_x + 2*tx;
+					float min_value = below.min_values[first];
+					float max_value = below.max_values[first];
+
+					for(size_t cy = 2*ty; cy < 2*ty + 2 && cy < below.tiles_y; cy++)
+					{
+						for(size_t cx = 2*tx; cx < 2*tx + 2 && cx < below.tiles_x; cx++)
+						{
+							size_t index = cy*below.tiles_x + cx;
+
+							if(below.min_values[index] < min_value)
+								min_value = below.min_values[index];
+
+							if(below.max_values[index] > max_value)
+								max_value = below.max_values[index];
+						}
+					}
+
+					above.min_values[ty*above.tiles_x + tx] = min_value;
+					above.max_values[ty*above.tiles_x + tx] = max_value;
+				}
+			}
+
+			levels.push_back(above);
+		}
+	}
+};
+
+
+// Adaptive marching squares over a min/max pyramid.
+// Starting from the top of the pyramid, a tile whose whole range is inside the
+// isosurface is emitted as one rectangle (two triangles), a tile whose whole
+// range is outside is skipped, and a tile that straddles the isovalue is split
+// into its four children. Straddling level 0 tiles are marched grid square by
+// grid square, so the line segments are exactly those of the uniform march.
+// Grid vertex positions are computed from their grid indices, which keeps the
+// vertices shared between neighbouring tiles identical, and the output crack-free.
+class adaptive_marcher
+{
+public:
+	size_t boundary_count;
+	size_t interior_count;
+	size_t tiles_marched;
+
+	adaptive_marcher(const float *const src_pixels, const unsigned short int src_px, const unsigned short int src_py, const min_max_pyramid &src_pyramid, const double src_grid_x_min, const double src_grid_y_max, const double src_step_size)
+		: pyramid(src_pyramid)
+	{
+		pixels = src_pixels;
+		px = src_px;
+		py = src_py;
+		grid_x_min = src_grid_x_min;
+		grid_y_max = src_grid_y_max;
+		step_size = src_step_size;
+		boundary_count = 0;
+		interior_count = 0;
+		tiles_marched = 0;
+	}
+
+	void march(vector<line_segment> &line_segments, vector<triangle> &triangles, const double isovalue)
+	{
+		if(0 == pyramid.levels.size())
+			return;
+
+		const size_t top = pyramid.levels.size() - 1;
+
+		for(size_t ty = 0; ty < pyramid.levels[top].tiles_y; ty++)
+			for(size_t tx = 0; tx < pyramid.levels[top].tiles_x; tx++)
+				visit(top, tx, ty, line_segments, triangles, isovalue);
+	}
+
+private:
+	const float *pixels;
+	unsigned short int px;
+	unsigned short int py;
+	const min_max_pyramid &pyramid;
+	double grid_x_min;
+	double grid_y_max;
+	double step_size;
+
+	inline double grid_x(const size_t x) const
+	{
+		return grid_x_min + static_cast<double>(x)*step_size;
+	}
+
+	inline double grid_y(const size_t y) const
+	{
+		return grid_y_max - static_cast<double>(y)*step_size;
+	}
+
+	void visit(const size_t l, const size_t tx, const size_t ty, vector<line_segment> &line_segments, vector<triangle> &triangles, const double isovalue)
+	{
+		const min_max_pyramid::level &lev = pyramid.levels[l];
+		const size_t index = ty*lev.tiles_x + tx;
+
+		// Entirely outside of image area: no geometry.
+		if(lev.max_values[index] < isovalue)
+			return;
+
+		size_t x_begin = tx*lev.tile_size;
+		size_t y_begin = ty*lev.tile_size;
+		size_t x_end = x_begin + lev.tile_size;
+		size_t y_end = y_begin + lev.tile_size;
+
+		if(x_end > static_cast<size_t>(px) - 1)
+			x_end = px - 1;
+
+		if(y_end > static_cast<size_t>(py) - 1)
+			y_end = py - 1;
+
+		// Entirely inside of image area: the same area as case 15 for every grid square.
+		if(lev.min_values[index] >= isovalue)
+		{
+			// Corner vertex order: 03
+			//                      12
+			triangle t;
+
+			t.vertex[0] = vertex_2(grid_x(x_begin), grid_y(y_begin));
+			t.vertex[1] = vertex_2(grid_x(x_begin), grid_y(y_end));
+			t.vertex[2] = vertex_2(grid_x(x_end), grid_y(y_begin));
+			triangles.push_back(t);
+
+			t.vertex[0] = vertex_2(grid_x(x_end), grid_y(y_begin));
+			t.vertex[1] = vertex_2(grid_x(x_begin), grid_y(y_end));
+			t.vertex[2] = vertex_2(grid_x(x_end), grid_y(y_end));
+			triangles.push_back(t);
+
+			interior_count += (x_end - x_begin)*(y_end - y_begin);
+
+			return;
+		}
+
+		if(0 != l)
+		{
+			const min_max_pyramid::level &below = pyramid.levels[l - 1];
+
+			for(size_t cy = 2*ty; cy < 2*ty + 2 && cy < below.tiles_y; cy++)
+				for(size_t cx = 2*tx; cx < 2*tx + 2 && cx < below.tiles_x; cx++)
+					visit(l - 1, cx, cy, line_segments, triangles, isovalue);
+
+			return;
+		}
+
+		// Straddling level 0 tile: march at pixel resolution.
+		grid_square g;
+
+		tiles_marched++;
+
+		for(size_t y = y_begin; y < y_end; y++)
+		{
+			for(size_t x = x_begin; x < x_end; x++)
+			{
+				// Corner vertex order: 03
+				//                      12
+				// e.g.: clockwise, as in OpenGL
+				g.vertex[0] = vertex_2(grid_x(x), grid_y(y));
+				g.vertex[1] = vertex_2(grid_x(x), grid_y(y + 1));
+				g.vertex[2] = vertex_2(grid_x(x + 1), grid_y(y + 1));
+				g.vertex[3] = vertex_2(grid_x(x + 1), grid_y(y));
+
+				g.value[0] = pixels[y*px + x];
+				g.value[1] = pixels[(y + 1)*px + x];
+				g.value[2] = pixels[(y + 1)*px + (x + 1)];
+				g.value[3] = pixels[y*px + (x + 1)];
+
+				size_t curr_ls_size = line_segments.size();
+				size_t curr_tris_size = triangles.size();
+
+				g.generate_primitives(line_segments, triangles, isovalue);
+
+				if(curr_ls_size != line_segments.size())
+					boundary_count++;
+
+				if(curr_tris_size != triangles.size())
+					interior_count++;
+			}
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,2102 @@
+#include "selftest.h"
+#include "march.h"
+#include "quadtree.h"
+#include "interior.h"
+#include "components.h"
+#include "image.h"
+#include "server.h"
+
+#include <vector>
+using std::vector;
+
+#include <string>
+using std::string;
+
+#include <sstream>
+using std::ostringstream;
+
+#include <fstream>
+using std::ofstream;
+
+#include <ios>
+using std::ios;
+
+#include <thread>
+using std::thread;
+
+#include <chrono>
+using std::chrono::steady_clock;
+using std::chrono::duration;
+
+#include <algorithm>
+using std::sort;
+
+#include <map>
+using std::map;
+
+#include <iostream>
+using std::cout;
+using std::endl;
+
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#include <sys/socket.h>
+#endif
+
+
+// The original marching squares kernel, before the case tables, kept unchanged as the reference.
+class reference_grid_square
+{
+public:
+	vertex_2 vertex[4];
+	double value[4];
+
+	inline vertex_2 vertex_interp(const vertex_2 &p1, const vertex_2 &p2, const double v1, const double v2, const double isovalue)
+	{
+		static vertex_2 temp;
+		static double mu;
+
+		// http://local.wasp.uwa.edu.au/~pbourke/geometry/polygonise/
+		mu = (isovalue - v1)/(v2 - v1);
+		temp.x = p1.x + mu*(p2.x - p1.x);
+		temp.y = p1.y + mu*(p2.y - p1.y);
+
+		return temp;
+	}
+
+	inline void generate_primitives(vector<line_segment> &line_segments, vector<triangle> &triangles, const double isovalue)
+	{
+		// Identify which of the 4 corners of the square are within the isosurface.
+		// Max 16 cases. Only 14 cases produce triangles and image edge line segments.
+
+		// Corner vertex order: 03
+		//                      12
+		// e.g.: clockwise, as in OpenGL
+
+		unsigned short int mask = 0;
+
+		if(value[0] >= isovalue) 
+			mask |= 1;
+
+		if(value[1] >= isovalue)
+			mask |= 2;
+
+		if(value[2] >= isovalue)
+			mask |= 4;
+
+		if(value[3] >= isovalue)
+			mask |= 8;
+
+		// Max 6 vertices per grid cube.
+		static vertex_2 a, b, c, d, e, f;
+		
+		// Max three triangles per grid cube.
+		static triangle t;
+
+		// Max two image edge line segments per grid cube.
+		static line_segment ls;
+
+		// Handle the 16 cases manually.
+		switch(mask)
+		{
+			case 1:
+			{
+				//1:
+				//10
+				//00
+
+				a = vertex[0];
+				b = vertex_interp(vertex[0], vertex[1], value[0], value[1], isovalue);
+				c = vertex_interp(vertex[0], vertex[3], value[0], value[3], isovalue);
+
+				t.vertex[0] = a;
+				t.vertex[1] = b;
+				t.vertex[2] = c;
+
+				ls.vertex[0] = b;
+				ls.vertex[1] = c;
+
+				triangles.push_back(t);
+				line_segments.push_back(ls);
+
+				break;
+			}
+			case 2:
+			{
+				//2:
+				//00
+				//10
+
+				a = vertex_interp(vertex[1], vertex[0], value[1], value[0], isovalue);
+				b = vertex[1];
+				c = vertex_interp(vertex[1], vertex[2], value[1], value[2], isovalue);
+
+				t.vertex[0] = a;
+				t.vertex[1] = b;
+				t.vertex[2] = c;
+				triangles.push_back(t);
+
+				ls.vertex[0] = a;
+				ls.vertex[1] = c;
+				line_segments.push_back(ls);
+
+				break;
+			}
+			case 4:
+			{
+				//4:
+				//00
+				//01
+
+				a = vertex_interp(vertex[2], vertex[1], value[2], value[1], isovalue);
+				b = vertex[2];
+				c = vertex_interp(vertex[2], vertex[3], value[2], value[3], isovalue);
+
+				t.vertex[0] = a;
+				t.vertex[1] = b;
+				t.vertex[2] = c;
+				triangles.push_back(t);
+
+				ls.vertex[0] = a;
+				ls.vertex[1] = c;
+				line_segments.push_back(ls);
+
+				break;
+			}
+			case 8:
+			{
+				//8:
+				//01
+				//00
+
+				a = vertex_interp(vertex[3], vertex[0], value[3], value[0], isovalue);
+				b = vertex_interp(vertex[3], vertex[2], value[3], value[2], isovalue);
+				c = vertex[3];
+
+				t.vertex[0] = a;
+				t.vertex[1] = b;
+				t.vertex[2] = c;
+				triangles.push_back(t);
+
+				ls.vertex[0] = a;
+				ls.vertex[1] = b;
+				line_segments.push_back(ls);
+
+				break;
+			}
+
+
+			case 3:
+			{
+				//3:
+				//10
+				//10
+
+				a = vertex[0];
+				b = vertex[1];
+				c = vertex_interp(vertex[1], vertex[2], value[1], value[2], isovalue);
+				d = vertex_interp(vertex[0], vertex[3], value[0], value[3], isovalue);
+
+				t.vertex[0] = a;
+				t.vertex[1] = b;
+				t.vertex[2] = d;
+				triangles.push_back(t);
+
+				t.vertex[0] = d;
+				t.vertex[1] = b;
+				t.vertex[2] = c;
+				triangles.push_back(t);
+
+				ls.vertex[0] = d;
+				ls.vertex[1] = c;
+				line_segments.push_back(ls);
+
+				break;
+			}
+			case 6:
+			{
+				//6:
+				//00
+				//11
+
+				a = vertex_interp(vertex[1], vertex[0], value[1], value[0], isovalue);
+				b = vertex[1];
+				c = vertex[2];
+				d = vertex_interp(vertex[2], vertex[3], value[2], value[3], isovalue);
+
+				t.vertex[0] = a;
+				t.vertex[1] = b;
+				t.vertex[2] = d;
+				triangles.push_back(t);
+
+				t.vertex[0] = d;
+				t.vertex[1] = b;
+				t.vertex[2] = c;
+				triangles.push_back(t);
+
+				ls.vertex[0] = a;
+				ls.vertex[1] = d;
+				line_segments.push_back(ls);
+
+				break;
+			}
+			case 9:
+			{
+				//9:
+				//11
+				//00
+
+				a = vertex[0];
+				b = vertex_interp(vertex[0], vertex[1], value[0], value[1], isovalue);
+				c = vertex_interp(vertex[3], vertex[2], value[3], value[2], isovalue);
+				d = vertex[3];
+
+				t.vertex[0] = a;
+				t.vertex[1] = b;
+				t.vertex[2] = d;
+				triangles.push_back(t);
+
+				t.vertex[0] = d;
+				t.vertex[1] = b;
+				t.vertex[2] = c;
+				triangles.push_back(t);
+
+				ls.vertex[0] = b;
+				ls.vertex[1] = c;
+				line_segments.push_back(ls);
+
+				break;
+			}
+			case 12:
+			{
+				//12:
+				//01
+				//01
+
+				a = vertex_interp(vertex[3], vertex[0], value[3], value[0], isovalue);
+				b = vertex_interp(vertex[2], vertex[1], value[2], value[1], isovalue);
+				c = vertex[2];
+				d = vertex[3];
+
+				t.vertex[0] = a;
+				t.vertex[1] = b;
+				t.vertex[2] = d;
+				triangles.push_back(t);
+
+				t.vertex[0] = d;
+				t.vertex[1] = b;
+				t.vertex[2] = c;
+				triangles.push_back(t);
+
+				ls.vertex[0] = a;
+				ls.vertex[1] = b;
+				line_segments.push_back(ls);
+
+				break;
+			}
+
+
+			case 5:
+			{
+				//5:
+				//10
+				//01
+
+				a = vertex[0];
+				b = vertex_interp(vertex[0], vertex[1], value[0], value[1], isovalue);
+				c = vertex_interp(vertex[0], vertex[3], value[0], value[3], isovalue);
+				d = vertex_interp(vertex[2], vertex[1], value[2], value[1], isovalue);
+				e = vertex[2];
+				f = vertex_interp(vertex[2], vertex[3], value[2], value[3], isovalue);
+
+				t.vertex[0] = a;
+				t.vertex[1] = b;
+				t.vertex[2] = c;
+				triangles.push_back(t);
+
+				t.vertex[0] = d;
+				t.vertex[1] = e;
+				t.vertex[2] = f;
+				triangles.push_back(t);
+
+				ls.vertex[0] = b;
+				ls.vertex[1] = c;
+				line_segments.push_back(ls);
+
+				ls.vertex[0] = d;
+				ls.vertex[1] = f;
+				line_segments.push_back(ls);
+
+				break;
+			}
+			case 10:
+			{
+				//10:
+				//01
+				//10
+
+				a = vertex_interp(vertex[1], vertex[0], value[1], value[0], isovalue);
+				b = vertex[1];
+				c = vertex_interp(vertex[1], vertex[2], value[1], value[2], isovalue);
+				d = vertex_interp(vertex[3], vertex[0], value[3], value[0], isovalue);
+				e = vertex_interp(vertex[3], vertex[2], value[3], value[2], isovalue);
+				f = vertex[3];
+
+				t.vertex[0] = a;
+				t.vertex[1] = b;
+				t.vertex[2] = c;
+				triangles.push_back(t);
+
+				t.vertex[0] = d;
+				t.vertex[1] = e;
+				t.vertex[2] = f;
+				triangles.push_back(t);
+
+				ls.vertex[0] = a;
+				ls.vertex[1] = c;
+				line_segments.push_back(ls);
+
+				ls.vertex[0] = d;
+				ls.vertex[1] = e;
+				line_segments.push_back(ls);
+
+				break;
+			}
+
+
+			case 7:
+			{
+				//7:
+				//10
+				//11
+
+				a = vertex[0];
+				b = vertex[1];
+				c = vertex[2];
+				d = vertex_interp(vertex[2], vertex[3], value[2], value[3], isovalue);
+				e = vertex_interp(vertex[0], vertex[3], value[0], value[3], isovalue);
+
+				t.vertex[0] = a;
+				t.vertex[1] = b;
+				t.vertex[2] = e;
+				triangles.push_back(t);
+
+				t.vertex[0] = e;
+				t.vertex[1] = b;
+				t.vertex[2] = d;
+				triangles.push_back(t);
+
+				t.vertex[0] = d;
+				t.vertex[1] = b;
+				t.vertex[2] = c;
+				triangles.push_back(t);
+
+				ls.vertex[0] = e;
+				ls.vertex[1] = d;
+				line_segments.push_back(ls);
+
+				break;
+			}
+			case 11:
+			{
+				//11:
+				//11
+				//10
+
+				a = vertex[0];
+				b = vertex[1];
+				c = vertex_interp(vertex[1], vertex[2], value[1], value[2], isovalue);
+				d = vertex_interp(vertex[3], vertex[2], value[3], value[2], isovalue);
+				e = vertex[3];
+
+				t.vertex[0] = a;
+				t.vertex[1] = b;
+				t.vertex[2] = c;
+				triangles.push_back(t);
+
+				t.vertex[0] = a;
+				t.vertex[1] = c;
+				t.vertex[2] = d;
+				triangles.push_back(t);
+
+				t.vertex[0] = a;
+				t.vertex[1] = d;
+				t.vertex[2] = e;
+				triangles.push_back(t);
+
+				ls.vertex[0] = c;
+				ls.vertex[1] = d;
+				line_segments.push_back(ls);
+
+				break;
+			}
+			case 13:
+			{
+				//13:
+				//11
+				//01
+
+				a = vertex[0];
+				b = vertex_interp(vertex[0], vertex[1], value[0], value[1], isovalue);
+				c = vertex_interp(vertex[2], vertex[1], value[2], value[1], isovalue);
+				d = vertex[2];
+				e = vertex[3];
+
+				t.vertex[0] = a;
+				t.vertex[1] = b;
+				t.vertex[2] = e;
+				triangles.push_back(t);
+
+				t.vertex[0] = e;
+				t.vertex[1] = b;
+				t.vertex[2] = c;
+				triangles.push_back(t);
+
+				t.vertex[0] = e;
+				t.vertex[1] = c;
+				t.vertex[2] = d;
+				triangles.push_back(t);
+
+				ls.vertex[0] = b;
+				ls.vertex[1] = c;
+				line_segments.push_back(ls);
+
+				break;
+			}
+			case 14:
+			{
+				//14:
+				//01
+				//11
+
+				a = vertex_interp(vertex[1], vertex[0], value[1], value[0], isovalue);
+				b = vertex[1];
+				c = vertex[2];
+				d = vertex[3];
+				e = vertex_interp(vertex[3], vertex[0], value[3], value[0], isovalue);
+
+				t.vertex[0] = a;
+				t.vertex[1] = b;
+				t.vertex[2] = c;
+				triangles.push_back(t);
+
+				t.vertex[0] = a;
+				t.vertex[1] = c;
+				t.vertex[2] = e;
+				triangles.push_back(t);
+
+				t.vertex[0] = e;
+				t.vertex[1] = c;
+				t.vertex[2] = d;
+				triangles.push_back(t);
+
+				ls.vertex[0] = a;
+				ls.vertex[1] = e;
+				line_segments.push_back(ls);
+
+				break;
+			}
+
+			case 15:
+			{
+				// Case 15 (all inside of image area) produces no outlines.
+
+				//15:
+				//11
+				//11
+
+				t.vertex[0] = vertex[0];
+				t.vertex[1] = vertex[1];
+				t.vertex[2] = vertex[3];
+				triangles.push_back(t);
+
+				t.vertex[0] = vertex[3];
+				t.vertex[1] = vertex[1];
+				t.vertex[2] = vertex[2];
+				triangles.push_back(t);
+
+				break;
+			}
+
+
+			default:
+			{
+				// Case 0 (all outside of image area) produces no geometry.
+
+				//0:
+				//00
+				//00
+
+				break;
+			}
+		}
+	}
+};
+
+
+// Records the strides of a progressive march.
+class level_recorder
+{
+public:
+	vector<size_t> strides;
+
+	void level(const size_t stride, const vector<line_segment> &, const vector<triangle> &, const geometry_stats &, const size_t, const size_t)
+	{
+		strides.push_back(stride);
+	}
+};
+
+// A test field: px x py values, top row first.
+class test_field
+{
+public:
+	string name;
+	unsigned short int px;
+	unsigned short int py;
+	vector<float> values;
+	bool is_byte_field; // All values are b/255.0f, for byte b in bytes.
+	vector<unsigned char> bytes;
+	double isovalue;
+
+	void set_bytes(const unsigned short int src_px, const unsigned short int src_py, const vector<unsigned char> &src_bytes)
+	{
+		px = src_px;
+		py = src_py;
+		bytes = src_bytes;
+		is_byte_field = true;
+
+		values.resize(bytes.size());
+
+		for(size_t i = 0; i < bytes.size(); i++)
+			values[i] = static_cast<float>(bytes[i])/255.0f;
+	}
+};
+
+// Small deterministic generator, so that a seed reproduces the same fields on every platform.
+class test_random
+{
+public:
+	unsigned long long state;
+
+	test_random(const unsigned long int seed) : state(seed*2 + 1) {}
+
+	unsigned int next(void)
+	{
+		state = state*6364136223846793005ULL + 1442695040888963407ULL;
+		return static_cast<unsigned int>(state >> 33);
+	}
+
+	// In [0, n).
+	unsigned int below(const unsigned int n)
+	{
+		return next() % n;
+	}
+
+	// In [0, 1).
+	double uniform(void)
+	{
+		return static_cast<double>(next())/2147483648.0;
+	}
+};
+
+// The march as main() performed it with the reference kernel, counting grid squares by the growth of the vectors.
+static void reference_march(const test_field &f, const double grid_x_min, const double grid_y_max, const double step_size, vector<line_segment> &line_segments, vector<triangle> &triangles, size_t &boundary_count, size_t &interior_count)
+{
+	reference_grid_square g;
+
+	double grid_x_pos = grid_x_min;
+	double grid_y_pos = grid_y_max;
+
+	for(short unsigned int y = 0; y < f.py - 1; y++, grid_y_pos -= step_size, grid_x_pos = grid_x_min)
+	{
+		for(short unsigned int x = 0; x < f.px - 1; x++, grid_x_pos += step_size)
+		{
+			g.vertex[0] = vertex_2(grid_x_pos, grid_y_pos);
+			g.vertex[1] = vertex_2(grid_x_pos, grid_y_pos - step_size);
+			g.vertex[2] = vertex_2(grid_x_pos + step_size, grid_y_pos - step_size);
+			g.vertex[3] = vertex_2(grid_x_pos + step_size, grid_y_pos);
+
+			g.value[0] = f.values[y*f.px + x];
+			g.value[1] = f.values[(y + 1)*f.px + x];
+			g.value[2] = f.values[(y + 1)*f.px + x + 1];
+			g.value[3] = f.values[y*f.px + x + 1];
+
+			size_t curr_ls_size = line_segments.size();
+			size_t curr_tris_size = triangles.size();
+
+			g.generate_primitives(line_segments, triangles, f.isovalue);
+
+			if(curr_ls_size != line_segments.size())
+				boundary_count++;
+
+			if(curr_tris_size != triangles.size())
+				interior_count++;
+		}
+	}
+}
+
+class selftest
+{
+public:
+	size_t num_fields;
+	size_t num_checks;
+	size_t num_failures;
+
+	selftest(void)
+	{
+		num_fields = 0;
+		num_checks = 0;
+		num_failures = 0;
+	}
+
+	void run(const test_field &f)
+	{
+		num_fields++;
+
+		const double step_size = 1.0/static_cast<double>(f.px - 1);
+		const double grid_x_min = -0.5;
+		const double grid_y_max = step_size*(f.py - 1)/2.0;
+		const double isovalue = f.isovalue;
+
+		// Reference.
+		vector<line_segment> ref_ls;
+		vector<triangle> ref_tris;
+		size_t ref_boundary = 0;
+		size_t ref_interior = 0;
+		reference_march(f, grid_x_min, grid_y_max, step_size, ref_ls, ref_tris, ref_boundary, ref_interior);
+
+		geometry_stats ref_stats;
+		ref_stats.gather(ref_ls, ref_tris, grid_x_min, grid_y_max);
+
+		// Table-driven kernel: the same geometry, in the same order.
+		{
+			vector<line_segment> ls;
+			vector<triangle> tris;
+			size_t boundary = 0;
+			size_t interior = 0;
+			march_field(&f.values[0], f.px, f.py, grid_x_min, grid_y_max, step_size, isovalue, ls, tris, boundary, interior);
+
+			check_exact(f, "table kernel", ref_ls, ref_tris, ls, tris);
+			check(f, "table kernel grid square counts", ref_boundary == boundary && ref_interior == interior);
+		}
+
+		// Progressive march: the last level is the full march.
+		{
+			vector<line_segment> ls;
+			vector<triangle> tris;
+			size_t boundary = 0;
+			size_t interior = 0;
+			level_recorder r;
+			march_field_progressive(&f.values[0], f.px, f.py, grid_x_min, grid_y_max, step_size, isovalue, ls, tris, boundary, interior, r);
+
+			check_exact(f, "progressive march last level", ref_ls, ref_tris, ls, tris);
+			check(f, "progressive march levels", 0 != r.strides.size() && 1 == r.strides.back() && ref_boundary == boundary && ref_interior == interior);
+		}
+
+		// Sinks.
+		{
+			geometry_stats stats;
+			stats.begin(grid_x_min, grid_y_max);
+			size_t boundary = 0;
+			size_t interior = 0;
+			march_field(&f.values[0], f.px, f.py, grid_x_min, grid_y_max, step_size, isovalue, stats, boundary, interior);
+
+			check_stats(f, "stats sink", ref_stats, stats);
+
+			count_sink counts;
+			march_field(&f.values[0], f.px, f.py, grid_x_min, grid_y_max, step_size, isovalue, counts, boundary, interior);
+
+			check(f, "count sink", ref_ls.size() == counts.num_line_segments && ref_tris.size() == counts.num_triangles);
+		}
+
+		// 8-bit field.
+		if(true == f.is_byte_field)
+		{
+			vector<line_segment> ls;
+			vector<triangle> tris;
+			size_t boundary = 0;
+			size_t interior = 0;
+			march_byte_field(&f.bytes[0], f.px, f.py, grid_x_min, grid_y_max, step_size, isovalue, ls, tris, boundary, interior);
+
+			check_exact(f, "8-bit field", ref_ls, ref_tris, ls, tris);
+			check(f, "8-bit field grid square counts", ref_boundary == boundary && ref_interior == interior);
+		}
+
+		// Adaptive march: visits the grid squares in a different order, and merges fully-inside tiles.
+		{
+			min_max_pyramid pyramid;
+			pyramid.build(&f.values[0], f.px, f.py);
+
+			vector<line_segment> ls;
+			vector<triangle> tris;
+			adaptive_marcher am(&f.values[0], f.px, f.py, pyramid, grid_x_min, grid_y_max, step_size);
+			am.march(ls, tris, isovalue);
+
+			check_merged(f, "adaptive march", ref_ls, ref_stats, ls, tris, grid_x_min, grid_y_max);
+			check(f, "adaptive march grid square counts", ref_boundary == am.boundary_count && ref_interior == am.interior_count);
+		}
+
+		// Component labelling, keeping every component: writes components out of row order.
+		vector<double> component_areas;
+
+		{
+			vector<line_segment> ls;
+			vector<triangle> tris;
+			size_t boundary = 0;
+			size_t interior = 0;
+			component_labeler labeler(0);
+			smoothed_rows rows(&f.values[0], f.px, f.py);
+
+			march_rows(rows, f.px, f.py, grid_x_min, grid_y_max, step_size, isovalue, 0, 0, &labeler, ls, tris, boundary, interior);
+
+			check_canonical(f, "component labeler", ref_ls, ref_tris, ls, tris);
+			check(f, "component labeler grid square counts", ref_boundary == boundary && ref_interior == interior);
+
+			double area = 0;
+			size_t num_ls = 0;
+
+			for(size_t i = 0; i < labeler.components.size(); i++)
+			{
+				area += labeler.components[i].area;
+				num_ls += labeler.components[i].num_line_segments;
+				component_areas.push_back(labeler.components[i].area);
+			}
+
+			check(f, "component totals", num_ls == ref_ls.size() && close(area, ref_stats.area));
+		}
+
+		// Component labelling with a minimum area above the smallest component's:
+		// the kept components account for exactly the geometry written out.
+		sort(component_areas.begin(), component_areas.end());
+
+		size_t smallest_kept = component_areas.size()/2;
+
+		while(smallest_kept < component_areas.size() && component_areas[smallest_kept] == component_areas[0])
+			smallest_kept++;
+
+		if(smallest_kept < component_areas.size())
+		{
+			const double min_area = component_areas[smallest_kept];
+
+			vector<line_segment> ls;
+			vector<triangle> tris;
+			size_t boundary = 0;
+			size_t interior = 0;
+			component_labeler labeler(min_area);
+			smoothed_rows rows(&f.values[0], f.px, f.py);
+
+			march_rows(rows, f.px, f.py, grid_x_min, grid_y_max, step_size, isovalue, 0, 0, &labeler, ls, tris, boundary, interior);
+
+			geometry_stats stats;
+			stats.gather(ls, tris, grid_x_min, grid_y_max);
+
+			double area = 0;
+			double length = 0;
+			size_t num_ls = 0;
+			size_t num_tris = 0;
+			bool all_large = true;
+
+			for(size_t i = 0; i < labeler.components.size(); i++)
+			{
+				area += labeler.components[i].area;
+				length += labeler.components[i].length;
+				num_ls += labeler.components[i].num_line_segments;
+				num_tris += labeler.components[i].num_triangles;
+				all_large = all_large && labeler.components[i].area >= min_area;
+			}
+
+			check(f, "component labeler minimum area", true == all_large && 0 != labeler.num_dropped && labeler.components.size() + labeler.num_dropped == component_areas.size());
+			check(f, "kept component totals", num_ls == ls.size() && num_tris == tris.size() && close(area, stats.area) && close(length, stats.length));
+		}
+
+		// Contour simplification: within the tolerance of the original contours, in no more line segments.
+		{
+			vector<line_segment> ls;
+			vector<triangle> tris;
+			size_t boundary = 0;
+			size_t interior = 0;
+			const double tolerance = 1.5*step_size;
+			contour_simplifier simplifier(tolerance);
+			smoothed_rows rows(&f.values[0], f.px, f.py);
+
+			march_rows(rows, f.px, f.py, grid_x_min, grid_y_max, step_size, isovalue, &simplifier, 0, 0, ls, tris, boundary, interior);
+
+			check_simplified(f, "simplified contours", ref_ls, ls, tolerance, grid_x_min, grid_y_max);
+			check(f, "simplified contours triangles", ref_tris.size() == tris.size());
+		}
+
+		// Interior merging: the same contours, and the same area in fewer triangles.
+		{
+			vector<line_segment> ls;
+			vector<triangle> tris;
+			size_t boundary = 0;
+			size_t interior = 0;
+			interior_mesher mesher;
+			smoothed_rows rows(&f.values[0], f.px, f.py);
+
+			march_rows(rows, f.px, f.py, grid_x_min, grid_y_max, step_size, isovalue, 0, &mesher, 0, ls, tris, boundary, interior);
+
+			check_merged(f, "merged interior", ref_ls, ref_stats, ls, tris, grid_x_min, grid_y_max);
+			check(f, "merged interior grid square counts", ref_boundary == boundary && ref_interior == interior);
+		}
+	}
+
+	// Also checks the reference itself against known counts.
+	void run(const test_field &f, const size_t expected_line_segments, const size_t expected_triangles)
+	{
+		vector<line_segment> ls;
+		vector<triangle> tris;
+		size_t boundary = 0;
+		size_t interior = 0;
+		const double step_size = 1.0/static_cast<double>(f.px - 1);
+		reference_march(f, -0.5, step_size*(f.py - 1)/2.0, step_size, ls, tris, boundary, interior);
+
+		check(f, "corpus counts", expected_line_segments == ls.size() && expected_triangles == tris.size());
+
+		if(expected_line_segments != ls.size() || expected_triangles != tris.size())
+			cout << "  reference gives " << ls.size() << " line segments, " << tris.size() << " triangles" << endl;
+
+		run(f);
+	}
+
+	static bool close(const double a, const double b)
+	{
+		return fabs(a - b) <= 1e-9*(1.0 + fabs(a) + fabs(b));
+	}
+
+	static bool close(const vertex_2 &a, const vertex_2 &b)
+	{
+		return close(a.x, b.x) && close(a.y, b.y);
+	}
+
+	void check(const test_field &f, const char *const what, const bool passed)
+	{
+		num_checks++;
+
+		if(true == passed)
+			return;
+
+		num_failures++;
+		cout << "FAILED: " << what << ", field " << f.name << " (" << f.px << " x " << f.py << "), isovalue " << f.isovalue << endl;
+	}
+
+	// A check that is not about one field.
+	void check(const char *const what, const bool passed)
+	{
+		num_checks++;
+
+		if(true == passed)
+			return;
+
+		num_failures++;
+		cout << "FAILED: " << what << endl;
+	}
+
+	static bool same(const line_segment &a, const line_segment &b)
+	{
+		return a.vertex[0] == b.vertex[0] && a.vertex[1] == b.vertex[1];
+	}
+
+	static bool same(const triangle &a, const triangle &b)
+	{
+		return a.vertex[0] == b.vertex[0] && a.vertex[1] == b.vertex[1] && a.vertex[2] == b.vertex[2];
+	}
+
+	void check_exact(const test_field &f, const char *const what, const vector<line_segment> &ref_ls, const vector<triangle> &ref_tris, const vector<line_segment> &ls, const vector<triangle> &tris)
+	{
+		bool passed = ref_ls.size() == ls.size() && ref_tris.size() == tris.size();
+
+		for(size_t i = 0; true == passed && i < ls.size(); i++)
+			passed = same(ref_ls[i], ls[i]);
+
+		for(size_t i = 0; true == passed && i < tris.size(); i++)
+			passed = same(ref_tris[i], tris[i]);
+
+		check(f, what, passed);
+	}
+
+	// Undirected line segments, with the lesser vertex first.
+	static line_segment canonical(const line_segment &ls)
+	{
+		line_segment c = ls;
+
+		if(c.vertex[1] < c.vertex[0])
+		{
+			c.vertex[0] = ls.vertex[1];
+			c.vertex[1] = ls.vertex[0];
+		}
+
+		return c;
+	}
+
+	// Triangles rotated to start at the least vertex, keeping the winding.
+	static triangle canonical(const triangle &t)
+	{
+		size_t first = 0;
+
+		for(size_t i = 1; i < 3; i++)
+			if(t.vertex[i] < t.vertex[first])
+				first = i;
+
+		triangle c;
+
+		for(size_t i = 0; i < 3; i++)
+			c.vertex[i] = t.vertex[(first + i) % 3];
+
+		return c;
+	}
+
+	static bool less(const line_segment &a, const line_segment &b)
+	{
+		if(a.vertex[0] < b.vertex[0])
+			return true;
+
+		if(b.vertex[0] < a.vertex[0])
+			return false;
+
+		return a.vertex[1] < b.vertex[1];
+	}
+
+	static bool less(const triangle &a, const triangle &b)
+	{
+		for(size_t i = 0; i < 3; i++)
+		{
+			if(a.vertex[i] < b.vertex[i])
+				return true;
+
+			if(b.vertex[i] < a.vertex[i])
+				return false;
+		}
+
+		return false;
+	}
+
+	template<class primitive>
+	static vector<primitive> canonical(const vector<primitive> &primitives)
+	{
+		vector<primitive> c(primitives.size());
+
+		for(size_t i = 0; i < primitives.size(); i++)
+			c[i] = canonical(primitives[i]);
+
+		bool (*order)(const primitive &, const primitive &) = &selftest::less;
+		sort(c.begin(), c.end(), order);
+
+		return c;
+	}
+
+	// The same primitives, in any order, with matching vertices within tolerance.
+	void check_canonical(const test_field &f, const char *const what, const vector<line_segment> &ref_ls, const vector<triangle> &ref_tris, const vector<line_segment> &ls, const vector<triangle> &tris)
+	{
+		bool passed = ref_ls.size() == ls.size() && ref_tris.size() == tris.size();
+
+		if(true == passed)
+		{
+			vector<line_segment> a = canonical(ref_ls);
+			vector<line_segment> b = canonical(ls);
+
+			for(size_t i = 0; true == passed && i < a.size(); i++)
+				passed = close(a[i].vertex[0], b[i].vertex[0]) && close(a[i].vertex[1], b[i].vertex[1]);
+		}
+
+		if(true == passed)
+		{
+			vector<triangle> a = canonical(ref_tris);
+			vector<triangle> b = canonical(tris);
+
+			for(size_t i = 0; true == passed && i < a.size(); i++)
+				passed = close(a[i].vertex[0], b[i].vertex[0]) && close(a[i].vertex[1], b[i].vertex[1]) && close(a[i].vertex[2], b[i].vertex[2]);
+		}
+
+		check(f, what, passed);
+	}
+
+	// The contour ends: vertices at which an odd number of (non-degenerate) line segments meet.
+	static vector<vertex_2> contour_ends(const vector<line_segment> &line_segments)
+	{
+		map<vertex_2, size_t> degrees;
+
+		for(size_t i = 0; i < line_segments.size(); i++)
+		{
+			if(line_segments[i].vertex[0] == line_segments[i].vertex[1])
+				continue;
+
+			degrees[line_segments[i].vertex[0]]++;
+			degrees[line_segments[i].vertex[1]]++;
+		}
+
+		vector<vertex_2> ends;
+
+		for(map<vertex_2, size_t>::const_iterator i = degrees.begin(); i != degrees.end(); i++)
+			if(1 == i->second % 2)
+				ends.push_back(i->first);
+
+		return ends;
+	}
+
+	// Simplified contours: no more line segments, the same contour ends (so closed contours
+	// stay closed), and every original vertex within the tolerance of a simplified line segment.
+	void check_simplified(const test_field &f, const char *const what, const vector<line_segment> &ref_ls, const vector<line_segment> &ls, const double tolerance, const double grid_x_min, const double grid_y_max)
+	{
+		check(f, what, ls.size() <= ref_ls.size() && contour_ends(ref_ls) == contour_ends(ls));
+
+		// Bucket the simplified line segments on a grid of tolerance-sized cells, by their
+		// bounds grown by the tolerance, so that each original vertex is tested against few.
+		const size_t cells_x = static_cast<size_t>(-2.0*grid_x_min/tolerance) + 3;
+		const size_t cells_y = static_cast<size_t>(2.0*grid_y_max/tolerance) + 3;
+		vector<vector<size_t> > cells(cells_x*cells_y);
+
+		for(size_t i = 0; i < ls.size(); i++)
+		{
+			const vertex_2 &a = ls[i].vertex[0];
+			const vertex_2 &b = ls[i].vertex[1];
+
+			const size_t x_begin = cell(a.x < b.x ? a.x : b.x, grid_x_min, -tolerance, tolerance, cells_x);
+			const size_t x_end = cell(a.x < b.x ? b.x : a.x, grid_x_min, tolerance, tolerance, cells_x);
+			const size_t y_begin = cell(a.y < b.y ? a.y : b.y, -grid_y_max, -tolerance, tolerance, cells_y);
+			const size_t y_end = cell(a.y < b.y ? b.y : a.y, -grid_y_max, tolerance, tolerance, cells_y);
+
+			for(size_t y = y_begin; y <= y_end; y++)
+				for(size_t x = x_begin; x <= x_end; x++)
+					cells[y*cells_x + x].push_back(i);
+		}
+
+		bool passed = true;
+
+		for(size_t i = 0; true == passed && i < ref_ls.size(); i++)
+		{
+			// Zero-length line segments (corner values equal to the isovalue) are dropped.
+			if(ref_ls[i].vertex[0] == ref_ls[i].vertex[1])
+				continue;
+
+			for(size_t j = 0; true == passed && j < 2; j++)
+			{
+				const vertex_2 &v = ref_ls[i].vertex[j];
+				const vector<size_t> &near = cells[cell(v.y, -grid_y_max, 0, tolerance, cells_y)*cells_x + cell(v.x, grid_x_min, 0, tolerance, cells_x)];
+
+				passed = false;
+
+				for(size_t k = 0; false == passed && k < near.size(); k++)
+					passed = distance_to_segment(v, ls[near[k]].vertex[0], ls[near[k]].vertex[1]) <= tolerance*(1.0 + 1e-9);
+			}
+		}
+
+		check(f, what, passed);
+	}
+
+	static size_t cell(const double v, const double origin, const double offset, const double size, const size_t num_cells)
+	{
+		const double c = floor((v + offset - origin)/size) + 1;
+
+		if(c < 0)
+			return 0;
+
+		if(c >= num_cells)
+			return num_cells - 1;
+
+		return static_cast<size_t>(c);
+	}
+
+	static double distance_to_segment(const vertex_2 &p, const vertex_2 &a, const vertex_2 &b)
+	{
+		const double dx = b.x - a.x;
+		const double dy = b.y - a.y;
+		const double length_squared = dx*dx + dy*dy;
+
+		double t = (0 == length_squared) ? 0 : ((p.x - a.x)*dx + (p.y - a.y)*dy)/length_squared;
+		t = (t < 0) ? 0 : ((t > 1) ? 1 : t);
+
+		return sqrt((a.x + t*dx - p.x)*(a.x + t*dx - p.x) + (a.y + t*dy - p.y)*(a.y + t*dy - p.y));
+	}
+
+	// Merged interiors: the same line segments, and the same area in no more triangles.
+	void check_merged(const test_field &f, const char *const what, const vector<line_segment> &ref_ls, const geometry_stats &ref_stats, const vector<line_segment> &ls, const vector<triangle> &tris, const double grid_x_min, const double grid_y_max)
+	{
+		vector<triangle> no_triangles;
+		check_canonical(f, what, ref_ls, no_triangles, ls, no_triangles);
+
+		geometry_stats stats;
+		stats.gather(ls, tris, grid_x_min, grid_y_max);
+
+		// Compare everything but the triangle count.
+		stats.num_triangles = ref_stats.num_triangles;
+		check_stats(f, what, ref_stats, stats);
+		check(f, what, tris.size() <= ref_stats.num_triangles);
+	}
+
+	void check_stats(const test_field &f, const char *const what, const geometry_stats &a, const geometry_stats &b)
+	{
+		check(f, what,	   a.num_line_segments == b.num_line_segments
+						&& a.num_triangles == b.num_triangles
+						&& close(a.length, b.length)
+						&& close(a.area, b.area)
+						&& close(a.x_min, b.x_min)
+						&& close(a.x_max, b.x_max)
+						&& close(a.y_min, b.y_min)
+						&& close(a.y_max, b.y_max));
+	}
+};
+
+// Regression corpus: small byte fields, with the reference's line segment and triangle counts.
+class corpus_field
+{
+public:
+	const char *name;
+	unsigned short int px;
+	unsigned short int py;
+	char isovalue_level; // The isovalue is exactly this level's value: every pixel at this level is a tie.
+	const char *pixels; // Row by row, levels '0' - '9' for 0/9 ... 9/9 of 255.
+	size_t num_line_segments;
+	size_t num_triangles;
+};
+
+static const corpus_field corpus[] =
+{
+	{ "single pixel",       3, 3, '9', "000" "090" "000", 4, 4 },
+	{ "all inside",         3, 3, '9', "999" "999" "999", 0, 8 },
+	{ "all outside",        3, 3, '9', "000" "000" "000", 0, 0 },
+	{ "all ties",           3, 3, '5', "555" "555" "555", 0, 8 },
+	{ "saddle 5",           2, 2, '9', "90" "09", 2, 2 },
+	{ "saddle 10",          2, 2, '9', "09" "90", 2, 2 },
+	{ "checkerboard",       4, 4, '9', "9090" "0909" "9090" "0909", 18, 18 },
+	{ "ties at the corner", 3, 3, '5', "500" "000" "005", 2, 2 },
+	{ "ramp through ties",  5, 2, '5', "13579" "13579", 1, 6 },
+	{ "ring",               5, 5, '9', "99999" "90009" "90909" "90009" "99999", 16, 32 }
+};
+
+static void make_corpus_field(const corpus_field &c, test_field &f)
+{
+	vector<unsigned char> bytes(static_cast<size_t>(c.px)*c.py);
+
+	for(size_t i = 0; i < bytes.size(); i++)
+		bytes[i] = static_cast<unsigned char>((c.pixels[i] - '0')*255/9);
+
+	f.name = c.name;
+	f.set_bytes(c.px, c.py, bytes);
+	f.isovalue = static_cast<float>((c.isovalue_level - '0')*255/9)/255.0f;
+}
+
+// Smooth blobs, as in a blurred binary image.
+static void make_blobs(test_random &r, const unsigned short int px, const unsigned short int py, vector<unsigned char> &bytes)
+{
+	const size_t num_blobs = 1 + r.below(5);
+	vector<double> cx(num_blobs), cy(num_blobs), radius(num_blobs);
+
+	for(size_t b = 0; b < num_blobs; b++)
+	{
+		cx[b] = r.uniform()*px;
+		cy[b] = r.uniform()*py;
+		radius[b] = 1 + r.uniform()*px/3;
+	}
+
+	for(size_t y = 0; y < py; y++)
+	{
+		for(size_t x = 0; x < px; x++)
+		{
+			double v = 0;
+
+			for(size_t b = 0; b < num_blobs; b++)
+			{
+				const double dx = (x - cx[b])/radius[b];
+				const double dy = (y - cy[b])/radius[b];
+				v += exp(-(dx*dx + dy*dy));
+			}
+
+			bytes[y*px + x] = static_cast<unsigned char>(255*(v > 1 ? 1 : v));
+		}
+	}
+}
+
+static void make_random_field(test_random &r, const unsigned long int iteration, test_field &f)
+{
+	const unsigned short int px = static_cast<unsigned short int>(2 + r.below(70));
+	const unsigned short int py = static_cast<unsigned short int>(2 + r.below(70));
+	const size_t num_pixels = static_cast<size_t>(px)*py;
+
+	vector<unsigned char> bytes(num_pixels);
+
+	ostringstream name;
+	name << "#" << iteration << " ";
+
+	f.is_byte_field = false;
+
+	switch(iteration % 5)
+	{
+		case 0:
+		{
+			// Uniform noise in floats.
+			name << "noise";
+			f.px = px;
+			f.py = py;
+			f.values.resize(num_pixels);
+
+			for(size_t i = 0; i < num_pixels; i++)
+				f.values[i] = static_cast<float>(r.uniform());
+
+			f.isovalue = 0.05 + 0.9*r.uniform();
+			break;
+		}
+		case 1:
+		{
+			// A few levels, with the isovalue exactly on one of them.
+			name << "quantized ties";
+			const unsigned int num_levels = 2 + r.below(4);
+
+			for(size_t i = 0; i < num_pixels; i++)
+				bytes[i] = static_cast<unsigned char>(r.below(num_levels)*255/(num_levels - 1));
+
+			f.set_bytes(px, py, bytes);
+			f.isovalue = static_cast<float>((1 + r.below(num_levels - 1))*255/(num_levels - 1))/255.0f;
+			break;
+		}
+		case 2:
+		{
+			// Checkerboard, so that most grid squares are case 5 or 10 saddles, with some noise.
+			name << "saddles";
+			const unsigned char high = static_cast<unsigned char>(129 + r.below(127));
+			const unsigned char low = static_cast<unsigned char>(r.below(127));
+
+			for(size_t y = 0; y < py; y++)
+				for(size_t x = 0; x < px; x++)
+					bytes[y*px + x] = (0 == (x + y) % 2) ? high : low;
+
+			for(size_t i = 0; i < num_pixels/8; i++)
+				bytes[r.below(static_cast<unsigned int>(num_pixels))] = static_cast<unsigned char>(r.below(256));
+
+			f.set_bytes(px, py, bytes);
+			f.isovalue = (0 == r.below(2)) ? 0.5 : static_cast<float>(high)/255.0f;
+			break;
+		}
+		case 3:
+		{
+			// Smooth blobs, as in a blurred binary image.
+			name << "blobs";
+			make_blobs(r, px, py, bytes);
+			f.set_bytes(px, py, bytes);
+			f.isovalue = 0.1 + 0.8*r.uniform();
+			break;
+		}
+		default:
+		{
+			// Constant, on, above, or below the isovalue.
+			name << "constant";
+			const unsigned char value = static_cast<unsigned char>(r.below(256));
+
+			for(size_t i = 0; i < num_pixels; i++)
+				bytes[i] = value;
+
+			f.set_bytes(px, py, bytes);
+
+			const unsigned int which = r.below(3);
+
+			if(0 == which || 0 == value)
+				f.isovalue = static_cast<float>(value == 0 ? 1 : value)/255.0f;
+			else if(1 == which)
+				f.isovalue = (value - 0.5)/255.0;
+			else
+				f.isovalue = (value + 0.5)/255.0;
+
+			break;
+		}
+	}
+
+	f.name = name.str();
+}
+
+// Writes a byte field as an uncompressed 24-bit grey TGA, bottom row first.
+static bool write_test_tga(const char *const filename, const test_field &f)
+{
+	ofstream out(filename, ios::binary);
+
+	if(false == out.is_open())
+		return false;
+
+	unsigned char header[18] = { 0 };
+	header[2] = 2; // Uncompressed RGB.
+	header[12] = static_cast<unsigned char>(f.px & 0xff);
+	header[13] = static_cast<unsigned char>(f.px >> 8);
+	header[14] = static_cast<unsigned char>(f.py & 0xff);
+	header[15] = static_cast<unsigned char>(f.py >> 8);
+	header[16] = 24;
+
+	out.write(reinterpret_cast<const char *>(header), sizeof(header));
+
+	vector<unsigned char> row(static_cast<size_t>(f.px)*3);
+
+	for(size_t y = f.py; y-- > 0;)
+	{
+		for(size_t x = 0; x < f.px; x++)
+			row[x*3] = row[x*3 + 1] = row[x*3 + 2] = f.bytes[y*f.px + x];
+
+		out.write(reinterpret_cast<const char *>(&row[0]), row.size());
+	}
+
+	return !out.fail();
+}
+
+static void make_blob_field(test_random &r, const unsigned short int px, const unsigned short int py, test_field &f)
+{
+	vector<unsigned char> bytes(static_cast<size_t>(px)*py);
+	make_blobs(r, px, py, bytes);
+
+	f.name = "blobs";
+	f.set_bytes(px, py, bytes);
+	f.isovalue = 0.5;
+}
+
+// Otsu's method on histograms whose best split is known.
+static void run_histogram_checks(selftest &t)
+{
+	// Two levels: every split between them ties, so the split must fall halfway.
+	luma_histogram two_levels;
+	two_levels.counts[0] = 1000;
+	two_levels.counts[luma_histogram::num_bins - 1] = 3000;
+	t.check("Otsu isovalue, two levels at 0 and 1", fabs(two_levels.otsu_isovalue() - 0.5) <= 1.0/255.0);
+
+	luma_histogram two_inner_levels;
+	two_inner_levels.counts[50] = 2000;
+	two_inner_levels.counts[150] = 1000;
+	t.check("Otsu isovalue, two levels at 50 and 150", fabs(two_inner_levels.otsu_isovalue() - 100.0/255.0) <= 1.0/255.0);
+
+	luma_histogram one_level;
+	one_level.counts[200] = 1000;
+	t.check("Otsu isovalue, one level", 0.5 == one_level.otsu_isovalue());
+
+	// Three levels, with most of the pixels at the top two: the split goes between the bottom two.
+	luma_histogram three_levels;
+	three_levels.counts[0] = 1000;
+	three_levels.counts[200] = 1000;
+	three_levels.counts[255] = 1000;
+	const double isovalue = three_levels.otsu_isovalue();
+	t.check("Otsu isovalue, three levels", isovalue > 0.0 && isovalue < 200.0/255.0 && fabs(isovalue - 100.0/255.0) <= 1.0/255.0);
+}
+
+// Marches a field through the contour simplifier.
+static void simplify_field(const test_field &f, const double tolerance, vector<line_segment> &ref_ls, vector<line_segment> &ls, double &grid_x_min, double &grid_y_max)
+{
+	const double step_size = 1.0/static_cast<double>(f.px - 1);
+	grid_x_min = -0.5;
+	grid_y_max = step_size*(f.py - 1)/2.0;
+
+	vector<triangle> tris;
+	size_t boundary = 0;
+	size_t interior = 0;
+	march_field(&f.values[0], f.px, f.py, grid_x_min, grid_y_max, step_size, f.isovalue, ref_ls, tris, boundary, interior);
+
+	contour_simplifier simplifier(tolerance);
+	smoothed_rows rows(&f.values[0], f.px, f.py);
+	march_rows(rows, f.px, f.py, grid_x_min, grid_y_max, step_size, f.isovalue, &simplifier, 0, 0, ls, tris, boundary, interior);
+}
+
+// A straight edge simplifies to a line segment or two whatever its direction, including
+// directions that grow against the march order; a disc stays closed, in far fewer line segments.
+static void run_simplify_checks(selftest &t)
+{
+	const unsigned short int px = 64;
+	const unsigned short int py = 48;
+	const double pi = 4.0*atan(1.0);
+
+	for(size_t degrees = 0; degrees < 360; degrees += 15)
+	{
+		// A linear ramp, so that the contour is exactly straight.
+		const double angle = (degrees + 7)*pi/180.0;
+
+		test_field f;
+		ostringstream name;
+		name << "straight edge at " << degrees + 7 << " degrees";
+		f.name = name.str();
+		f.px = px;
+		f.py = py;
+		f.is_byte_field = false;
+		f.isovalue = 0.5;
+		f.values.resize(static_cast<size_t>(px)*py);
+
+		for(size_t y = 0; y < py; y++)
+			for(size_t x = 0; x < px; x++)
+				f.values[y*px + x] = static_cast<float>(0.5 + 0.01*((x - px/2.0)*cos(angle) + (y - py/2.0)*sin(angle)));
+
+		const double tolerance = 0.25/static_cast<double>(px - 1);
+		vector<line_segment> ref_ls, ls;
+		double grid_x_min, grid_y_max;
+		simplify_field(f, tolerance, ref_ls, ls, grid_x_min, grid_y_max);
+
+		t.check_simplified(f, "simplified straight edge", ref_ls, ls, tolerance, grid_x_min, grid_y_max);
+		t.check(f, "simplified straight edge, O(1) line segments", 0 != ls.size() && ls.size() <= 2);
+	}
+
+	{
+		test_field f;
+		f.name = "disc";
+		f.px = px;
+		f.py = py;
+		f.is_byte_field = false;
+		f.isovalue = 0.5;
+		f.values.resize(static_cast<size_t>(px)*py);
+
+		for(size_t y = 0; y < py; y++)
+		{
+			for(size_t x = 0; x < px; x++)
+			{
+				const double v = 0.5 + 0.2*(18.0 - sqrt((x - 30.5)*(x - 30.5) + (y - 23.5)*(y - 23.5)));
+				f.values[y*px + x] = static_cast<float>(v < 0 ? 0 : (v > 1 ? 1 : v));
+			}
+		}
+
+		const double tolerance = 0.5/static_cast<double>(px - 1);
+		vector<line_segment> ref_ls, ls;
+		double grid_x_min, grid_y_max;
+		simplify_field(f, tolerance, ref_ls, ls, grid_x_min, grid_y_max);
+
+		t.check_simplified(f, "simplified disc", ref_ls, ls, tolerance, grid_x_min, grid_y_max);
+		t.check(f, "simplified disc, closed", 0 == selftest::contour_ends(ls).size() && 3 <= ls.size());
+		t.check(f, "simplified disc, fewer line segments", ls.size()*4 <= ref_ls.size());
+	}
+}
+
+// The whole image's march, restricted to the grid squares of a window of pixels. The positions
+// are stepped from the window's top left pixel, as when the window is marched on its own.
+static void march_window(const float_grayscale &l, const pixel_region &r, const double grid_x_min, const double grid_y_max, const double step_size, const double isovalue, vector<line_segment> &line_segments, vector<triangle> &triangles)
+{
+	grid_square g;
+
+	const double window_x_min = grid_x_min + r.x_begin*step_size;
+
+	double grid_x_pos = window_x_min;
+	double grid_y_pos = grid_y_max - r.y_begin*step_size;
+
+	for(size_t y = r.y_begin; y + 1 < r.y_end; y++, grid_y_pos -= step_size, grid_x_pos = window_x_min)
+	{
+		for(size_t x = r.x_begin; x + 1 < r.x_end; x++, grid_x_pos += step_size)
+		{
+			g.vertex[0] = vertex_2(grid_x_pos, grid_y_pos);
+			g.vertex[1] = vertex_2(grid_x_pos, grid_y_pos - step_size);
+			g.vertex[2] = vertex_2(grid_x_pos + step_size, grid_y_pos - step_size);
+			g.vertex[3] = vertex_2(grid_x_pos + step_size, grid_y_pos);
+
+			g.value[0] = l.pixel_data[y*l.px + x];
+			g.value[1] = l.pixel_data[(y + 1)*l.px + x];
+			g.value[2] = l.pixel_data[(y + 1)*l.px + x + 1];
+			g.value[3] = l.pixel_data[y*l.px + x + 1];
+
+			g.generate_primitives(line_segments, triangles, isovalue);
+		}
+	}
+}
+
+// Converts regions of a generated TGA file, including ones at the image's edges, and checks
+// that each has the whole image's pixels there (black border included), and that marching it
+// in the whole image's frame gives the whole image's geometry in that window.
+static void run_region_checks(selftest &t, test_random &r)
+{
+	ostringstream name;
+	name << "selftest_region_" << getpid() << ".tga";
+	const string filename = name.str();
+
+	test_field f;
+	make_blob_field(r, 61, 47, f);
+	f.name = "region blobs";
+
+	tga whole_tga;
+	float_grayscale whole;
+
+	if(false == write_test_tga(filename.c_str(), f) || false == convert_tga_to_float_grayscale(filename.c_str(), whole_tga, whole, true, true, true))
+	{
+		t.check("region test image", false);
+		remove(filename.c_str());
+		return;
+	}
+
+	const double step_size = 1.0/static_cast<double>(whole.px - 1);
+	const double grid_x_min = -0.5;
+	const double grid_y_max = step_size*(whole.py - 1)/2.0;
+
+	vector<pixel_region> regions;
+	regions.push_back(pixel_region(0, 0, whole.px, whole.py));
+	regions.push_back(pixel_region(0, 0, 20, 15));
+	regions.push_back(pixel_region(whole.px - 20, whole.py - 15, whole.px, whole.py));
+	regions.push_back(pixel_region(10, 5, 50, 40));
+	regions.push_back(pixel_region(0, 20, whole.px, 22));
+
+	for(size_t i = 0; i < 10; i++)
+	{
+		const unsigned short int x_begin = static_cast<unsigned short int>(r.below(whole.px - 2));
+		const unsigned short int y_begin = static_cast<unsigned short int>(r.below(whole.py - 2));
+		const unsigned short int x_end = static_cast<unsigned short int>(x_begin + 2 + r.below(whole.px - x_begin - 1));
+		const unsigned short int y_end = static_cast<unsigned short int>(y_begin + 2 + r.below(whole.py - y_begin - 1));
+
+		regions.push_back(pixel_region(x_begin, y_begin, x_end, y_end));
+	}
+
+	for(size_t i = 0; i < regions.size(); i++)
+	{
+		const pixel_region &w = regions[i];
+
+		tga region_tga;
+		float_grayscale region;
+
+		if(false == convert_tga_region_to_float_grayscale(filename.c_str(), region_tga, region, w, true, true, true))
+		{
+			t.check(f, "region conversion", false);
+			continue;
+		}
+
+		bool same_pixels = region.px == w.x_end - w.x_begin && region.py == w.y_end - w.y_begin;
+
+		for(size_t y = 0; true == same_pixels && y < region.py; y++)
+			for(size_t x = 0; true == same_pixels && x < region.px; x++)
+				same_pixels = region.pixel_data[y*region.px + x] == whole.pixel_data[(w.y_begin + y)*whole.px + w.x_begin + x];
+
+		t.check(f, "region pixels", same_pixels);
+
+		if(false == same_pixels)
+			continue;
+
+		vector<line_segment> ref_ls;
+		vector<triangle> ref_tris;
+		march_window(whole, w, grid_x_min, grid_y_max, step_size, f.isovalue, ref_ls, ref_tris);
+
+		vector<line_segment> ls;
+		vector<triangle> tris;
+		size_t boundary = 0;
+		size_t interior = 0;
+		march_field(&region.pixel_data[0], region.px, region.py, grid_x_min + w.x_begin*step_size, grid_y_max - w.y_begin*step_size, step_size, f.isovalue, ls, tris, boundary, interior);
+
+		t.check_exact(f, "region march", ref_ls, ref_tris, ls, tris);
+	}
+
+	remove(filename.c_str());
+}
+
+#ifndef _WIN32
+
+// A client for the query server, as described in server.h.
+class server_client
+{
+public:
+	int fd;
+
+	bool send(const unsigned int opcode, const unsigned long long request_id, const vector<char> &payload)
+	{
+		message_header h;
+		h.magic = server_magic;
+		h.code = opcode;
+		h.request_id = request_id;
+		h.payload_size = payload.size();
+
+		return write_fully(&h, sizeof(h)) && (0 == payload.size() || write_fully(&payload[0], payload.size()));
+	}
+
+	bool receive(message_header &h, vector<char> &payload)
+	{
+		if(false == read_fully(&h, sizeof(h)) || server_magic != h.magic)
+			return false;
+
+		payload.resize(static_cast<size_t>(h.payload_size));
+
+		return 0 == payload.size() || read_fully(&payload[0], payload.size());
+	}
+
+	// Sends a request and waits for its response, the only one outstanding.
+	bool request(const unsigned int opcode, const unsigned long long request_id, const vector<char> &payload, message_header &h, vector<char> &response)
+	{
+		return send(opcode, request_id, payload) && receive(h, response) && request_id == h.request_id;
+	}
+
+	template<class T>
+	static void append(vector<char> &buffer, const T &value)
+	{
+		const char *p = reinterpret_cast<const char *>(&value);
+		buffer.insert(buffer.end(), p, p + sizeof(T));
+	}
+
+	template<class T>
+	static T at(const vector<char> &buffer, const size_t offset)
+	{
+		T value = T();
+
+		if(offset + sizeof(T) <= buffer.size())
+			memcpy(&value, &buffer[offset], sizeof(T));
+
+		return value;
+	}
+
+	static vector<char> load_payload(const double template_width, const string &filename)
+	{
+		vector<char> payload;
+		append(payload, template_width);
+		payload.insert(payload.end(), filename.begin(), filename.end());
+
+		return payload;
+	}
+
+	static vector<char> query_payload(const unsigned int id, const double isovalue)
+	{
+		vector<char> payload;
+		append(payload, id);
+		append(payload, static_cast<unsigned int>(0));
+		append(payload, isovalue);
+
+		return payload;
+	}
+
+	static vector<char> unload_payload(const unsigned int id)
+	{
+		vector<char> payload;
+		append(payload, id);
+
+		return payload;
+	}
+
+private:
+	bool read_fully(void *const buffer, const size_t num_bytes)
+	{
+		char *p = static_cast<char *>(buffer);
+
+		for(size_t done = 0; done < num_bytes;)
+		{
+			ssize_t n = read(fd, p + done, num_bytes - done);
+
+			if(n <= 0)
+				return false;
+
+			done += static_cast<size_t>(n);
+		}
+
+		return true;
+	}
+
+	bool write_fully(const void *const buffer, const size_t num_bytes)
+	{
+		const char *p = static_cast<const char *>(buffer);
+
+		for(size_t done = 0; done < num_bytes;)
+		{
+			ssize_t n = write(fd, p + done, num_bytes - done);
+
+			if(n <= 0)
+				return false;
+
+			done += static_cast<size_t>(n);
+		}
+
+		return true;
+	}
+};
+
+// What the server should answer for a TGA file, marched here directly.
+class server_expected
+{
+public:
+	vector<line_segment> line_segments;
+	vector<triangle> triangles;
+	geometry_stats stats;
+	size_t boundary_count;
+	size_t interior_count;
+
+	bool march(const char *const filename, const double template_width, const double isovalue)
+	{
+		tga t;
+		float_grayscale l;
+
+		if(false == convert_tga_to_float_grayscale(filename, t, l, true, true, true))
+			return false;
+
+		const double step_size = template_width/static_cast<double>(l.px - 1);
+		const double grid_x_min = -template_width/2.0;
+		const double grid_y_max = step_size*(l.py - 1)/2.0;
+
+		boundary_count = 0;
+		interior_count = 0;
+		march_field(&l.pixel_data[0], l.px, l.py, grid_x_min, grid_y_max, step_size, isovalue, line_segments, triangles, boundary_count, interior_count);
+		stats.gather(line_segments, triangles, grid_x_min, grid_y_max);
+
+		return true;
+	}
+
+	bool same_stats(const vector<char> &response) const
+	{
+		return	   response.size() == 4*sizeof(unsigned long long) + 7*sizeof(double)
+				&& stats.num_line_segments == server_client::at<unsigned long long>(response, 0)
+				&& stats.num_triangles == server_client::at<unsigned long long>(response, 8)
+				&& boundary_count == server_client::at<unsigned long long>(response, 16)
+				&& interior_count == server_client::at<unsigned long long>(response, 24)
+				&& selftest::close(stats.length, server_client::at<double>(response, 32))
+				&& selftest::close(stats.area, server_client::at<double>(response, 40))
+				&& selftest::close(stats.x_min, server_client::at<double>(response, 48))
+				&& selftest::close(stats.x_max, server_client::at<double>(response, 56))
+				&& selftest::close(stats.y_min, server_client::at<double>(response, 64))
+				&& selftest::close(stats.y_max, server_client::at<double>(response, 72));
+	}
+
+	bool same_geometry(const vector<char> &response) const
+	{
+		const size_t num_doubles = line_segments.size()*4 + triangles.size()*6;
+
+		if(	   response.size() != 2*sizeof(unsigned long long) + num_doubles*sizeof(double)
+			|| line_segments.size() != server_client::at<unsigned long long>(response, 0)
+			|| triangles.size() != server_client::at<unsigned long long>(response, 8))
+			return false;
+
+		size_t offset = 2*sizeof(unsigned long long);
+
+		for(size_t i = 0; i < line_segments.size(); i++)
+			for(size_t j = 0; j < 2; j++, offset += 2*sizeof(double))
+				if(	   line_segments[i].vertex[j].x != server_client::at<double>(response, offset)
+					|| line_segments[i].vertex[j].y != server_client::at<double>(response, offset + sizeof(double)))
+					return false;
+
+		for(size_t i = 0; i < triangles.size(); i++)
+			for(size_t j = 0; j < 3; j++, offset += 2*sizeof(double))
+				if(	   triangles[i].vertex[j].x != server_client::at<double>(response, offset)
+					|| triangles[i].vertex[j].y != server_client::at<double>(response, offset + sizeof(double)))
+					return false;
+
+		return true;
+	}
+};
+
+// Runs the server on one end of a socket pair and checks each request type against a direct march,
+// including requests for two images in flight at once, and the errors.
+static void run_server_checks(selftest &t, test_random &r)
+{
+	ostringstream first_name, second_name;
+	first_name << "selftest_server_" << getpid() << "_1.tga";
+	second_name << "selftest_server_" << getpid() << "_2.tga";
+
+	const string filenames[2] = { first_name.str(), second_name.str() };
+	const double template_width = 2.0;
+	const double isovalue = 0.5;
+
+	test_field fields[2];
+	make_blob_field(r, 64, 48, fields[0]);
+	make_blob_field(r, 37, 53, fields[1]);
+
+	server_expected expected[2];
+
+	for(size_t i = 0; i < 2; i++)
+	{
+		if(false == write_test_tga(filenames[i].c_str(), fields[i]) || false == expected[i].march(filenames[i].c_str(), template_width, isovalue))
+		{
+			t.check("server test image", false);
+			remove(first_name.str().c_str());
+			remove(second_name.str().c_str());
+			return;
+		}
+	}
+
+	int fds[2];
+
+	if(0 != socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+	{
+		t.check("server socket pair", false);
+		return;
+	}
+
+	thread server([&fds]() { serve_stream(fds[1], fds[1]); });
+
+	server_client c;
+	c.fd = fds[0];
+
+	message_header h;
+	vector<char> response;
+	unsigned int ids[2] = { 0, 0 };
+
+	for(size_t i = 0; i < 2; i++)
+	{
+		bool loaded = c.request(server_load, 1 + i, server_client::load_payload(template_width, filenames[i]), h, response);
+
+		loaded = loaded && server_ok == h.code && 3*sizeof(unsigned int) == response.size();
+		loaded = loaded && fields[i].px == server_client::at<unsigned int>(response, 4) && fields[i].py == server_client::at<unsigned int>(response, 8);
+
+		ids[i] = server_client::at<unsigned int>(response, 0);
+
+		t.check("server load", loaded);
+	}
+
+	t.check("server image ids", ids[0] != ids[1]);
+
+	bool passed = c.request(server_stats, 3, server_client::query_payload(ids[0], isovalue), h, response);
+	t.check("server stats", passed && server_ok == h.code && expected[0].same_stats(response));
+
+	passed = c.request(server_extract, 4, server_client::query_payload(ids[0], isovalue), h, response);
+	t.check("server extract", passed && server_ok == h.code && expected[0].same_geometry(response));
+
+	// Both images at once; the responses may come back in any order.
+	passed =	   c.send(server_extract, 10, server_client::query_payload(ids[0], isovalue))
+				&& c.send(server_stats, 11, server_client::query_payload(ids[1], isovalue))
+				&& c.send(server_extract, 12, server_client::query_payload(ids[1], isovalue))
+				&& c.send(server_stats, 13, server_client::query_payload(ids[0], isovalue));
+
+	bool answered[4] = { false, false, false, false };
+
+	// Read every response, even after a mismatch, so that the later checks see their own.
+	for(size_t i = 0; i < 4; i++)
+	{
+		if(false == c.receive(h, response) || server_ok != h.code || 10 > h.request_id || 13 < h.request_id || true == answered[h.request_id - 10])
+		{
+			passed = false;
+			continue;
+		}
+
+		answered[h.request_id - 10] = true;
+
+		const server_expected &e = expected[(11 == h.request_id || 12 == h.request_id) ? 1 : 0];
+
+		if(false == ((0 == h.request_id % 2) ? e.same_geometry(response) : e.same_stats(response)))
+			passed = false;
+	}
+
+	t.check("server concurrent images", passed);
+
+	passed = c.request(99, 20, vector<char>(), h, response);
+	t.check("server unknown opcode", passed && server_error == h.code && 0 != response.size());
+
+	const unsigned int bad_id = ids[0] + ids[1] + 1;
+
+	passed = c.request(server_stats, 21, server_client::query_payload(bad_id, isovalue), h, response);
+	t.check("server bad image id", passed && server_error == h.code);
+
+	passed = c.request(server_unload, 22, server_client::unload_payload(ids[0]), h, response);
+	t.check("server unload", passed && server_ok == h.code && 0 == response.size());
+
+	passed = c.request(server_extract, 23, server_client::query_payload(ids[0], isovalue), h, response);
+	t.check("server query after unload", passed && server_error == h.code);
+
+	passed = c.request(server_unload, 24, server_client::unload_payload(ids[0]), h, response);
+	t.check("server unload twice", passed && server_error == h.code);
+
+	passed = c.request(server_stats, 25, server_client::query_payload(ids[1], isovalue), h, response);
+	t.check("server other image after unload", passed && server_ok == h.code && expected[1].same_stats(response));
+
+	c.request(server_unload, 26, server_client::unload_payload(ids[1]), h, response);
+
+	// End of input: the server finishes and returns.
+	shutdown(fds[0], SHUT_WR);
+	server.join();
+	close(fds[1]);
+
+	t.check("server end of input", false == c.receive(h, response));
+
+	close(fds[0]);
+
+	for(size_t i = 0; i < 2; i++)
+		remove(filenames[i].c_str());
+}
+
+#endif
+
+// Times one march: the best of a number of repetitions, after a warm-up run that
+// also sizes the output vectors, so that their growth is not timed.
+template<class march>
+static double best_time(const unsigned long int repetitions, march &m)
+{
+	m.run();
+
+	double best = 0;
+
+	for(unsigned long int i = 0; i < repetitions; i++)
+	{
+		m.clear();
+
+		const steady_clock::time_point start = steady_clock::now();
+		m.run();
+		const double seconds = duration<double>(steady_clock::now() - start).count();
+
+		if(0 == i || seconds < best)
+			best = seconds;
+	}
+
+	return best;
+}
+
+// The marches being timed, on one field. Each keeps its output, so that it is not optimized away.
+class benchmark_march
+{
+public:
+	enum march_type { reference, table_both, table_line_segments, table_triangles, table_stats, rows_both };
+
+	const test_field &f;
+	march_type type;
+	double grid_x_min;
+	double grid_y_max;
+	double step_size;
+
+	vector<line_segment> line_segments;
+	vector<triangle> triangles;
+	geometry_stats stats;
+	size_t boundary_count;
+	size_t interior_count;
+
+	benchmark_march(const test_field &src_f, const march_type src_type) : f(src_f), type(src_type)
+	{
+		step_size = 1.0/static_cast<double>(f.px - 1);
+		grid_x_min = -0.5;
+		grid_y_max = step_size*(f.py - 1)/2.0;
+		boundary_count = 0;
+		interior_count = 0;
+	}
+
+	void clear(void)
+	{
+		line_segments.clear();
+		triangles.clear();
+		boundary_count = 0;
+		interior_count = 0;
+	}
+
+	void run(void)
+	{
+		const float *const pixels = &f.values[0];
+
+		switch(type)
+		{
+			case reference:
+			{
+				reference_march(f, grid_x_min, grid_y_max, step_size, line_segments, triangles, boundary_count, interior_count);
+				break;
+			}
+			case table_both:
+			{
+				march_field(pixels, f.px, f.py, grid_x_min, grid_y_max, step_size, f.isovalue, line_segments, triangles, boundary_count, interior_count);
+				break;
+			}
+			case table_line_segments:
+			{
+				vector_sink<true, false> s(line_segments, triangles);
+				march_field(pixels, f.px, f.py, grid_x_min, grid_y_max, step_size, f.isovalue, s, boundary_count, interior_count);
+				break;
+			}
+			case table_triangles:
+			{
+				vector_sink<false, true> s(line_segments, triangles);
+				march_field(pixels, f.px, f.py, grid_x_min, grid_y_max, step_size, f.isovalue, s, boundary_count, interior_count);
+				break;
+			}
+			case table_stats:
+			{
+				stats.begin(grid_x_min, grid_y_max);
+				march_field(pixels, f.px, f.py, grid_x_min, grid_y_max, step_size, f.isovalue, stats, boundary_count, interior_count);
+				break;
+			}
+			default:
+			{
+				smoothed_rows rows(pixels, f.px, f.py);
+				march_rows(rows, f.px, f.py, grid_x_min, grid_y_max, step_size, f.isovalue, 0, 0, 0, line_segments, triangles, boundary_count, interior_count);
+				break;
+			}
+		}
+	}
+};
+
+static void run_benchmark_field(const test_field &f, const unsigned long int repetitions)
+{
+	static const char *const names[] =
+	{
+		"reference switch, both outputs ",
+		"table kernel, both outputs     ",
+		"table kernel, line segments    ",
+		"table kernel, triangles        ",
+		"table kernel, statistics only  ",
+		"row march, both outputs        "
+	};
+
+	cout << f.name << " field, isovalue " << f.isovalue << ":" << endl;
+
+	double reference_seconds = 0;
+
+	for(size_t i = 0; i < sizeof(names)/sizeof(names[0]); i++)
+	{
+		benchmark_march m(f, static_cast<benchmark_march::march_type>(i));
+		const double seconds = best_time(repetitions, m);
+
+		if(benchmark_march::reference == m.type)
+			reference_seconds = seconds;
+
+		cout << "  " << names[i] << " " << seconds*1000.0 << " ms";
+
+		if(benchmark_march::reference != m.type)
+			cout << " (" << reference_seconds/seconds << "x the reference)";
+
+		cout << endl;
+	}
+}
+
+int run_benchmark(const unsigned short int size, const unsigned long int repetitions, const unsigned long int seed)
+{
+	if(size < 3)
+	{
+		cout << "Benchmark field size must be at least 3 pixels." << endl;
+		return 1;
+	}
+
+	test_random r(seed);
+	const size_t num_pixels = static_cast<size_t>(size)*size;
+
+	cout << "Benchmark, " << size << " x " << size << " pixels, best of " << repetitions << ", seed " << seed << endl;
+
+	// Uniform noise: every grid square's case is unpredictable.
+	{
+		test_field f;
+		f.name = "noise";
+		f.px = size;
+		f.py = size;
+		f.is_byte_field = false;
+		f.values.resize(num_pixels);
+		f.isovalue = 0.5;
+
+		for(size_t i = 0; i < num_pixels; i++)
+			f.values[i] = static_cast<float>(r.uniform());
+
+		run_benchmark_field(f, repetitions);
+	}
+
+	// Smooth blobs: mostly empty or full grid squares, as in a binary image.
+	{
+		test_field f;
+		make_blob_field(r, size, size, f);
+		run_benchmark_field(f, repetitions);
+	}
+
+	return 0;
+}
+
+int run_selftest(const unsigned long int iterations, const unsigned long int seed)
+{
+	selftest t;
+
+	for(size_t i = 0; i < sizeof(corpus)/sizeof(corpus[0]); i++)
+	{
+		test_field f;
+		make_corpus_field(corpus[i], f);
+		t.run(f, corpus[i].num_line_segments, corpus[i].num_triangles);
+	}
+
+	test_random r(seed);
+
+	for(unsigned long int i = 0; i < iterations; i++)
+	{
+		test_field f;
+		make_random_field(r, i, f);
+		t.run(f);
+	}
+
+	run_histogram_checks(t);
+	run_simplify_checks(t);
+	run_region_checks(t, r);
+
+#ifndef _WIN32
+	run_server_checks(t, r);
+#endif
+
+	cout << "Self-test, seed " << seed << ": " << t.num_fields << " fields, " << t.num_checks << " checks, " << t.num_failures << " failures" << endl;
+
+	return (0 == t.num_failures) ? 0 : 1;
+}
@@ -0,0 +1,42 @@
+#ifndef SELFTEST_H
+#define SELFTEST_H
+
+// Differential self-test of the marching squares paths.
+//
+// The original hand-written 16-case kernel is kept as the reference, and every other
+// path is run against it on the same fields and isovalues:
+// the table-driven kernel and the last level of the progressive march (exact geometry,
+// in the same order), the statistics and count sinks, the 8-bit field, the adaptive march and the component labeler (same geometry,
+// in any order), and interior merging (same contours and area). The labeler and the mesher are
+// driven by march_rows(), as in main(). With a minimum component area, the kept components'
+// totals must match the geometry written out. The contour simplifier must keep every contour
+// end, and keep every vertex of the reference contours within its tolerance.
+//
+// Otsu's method must split histograms with two or three levels where expected, halfway
+// between two levels.
+//
+// Straight edges in every direction must simplify to one or two line segments, and a disc
+// must stay closed, in a quarter or fewer of its line segments.
+//
+// The fields are a fixed corpus of small regression fields, followed by random fields:
+// uniform noise, a few quantized levels with the isovalue set to one of them (exact ties),
+// checkerboards (case 5 and 10 saddles), smooth blobs, and constant fields.
+//
+// Regions of a generated TGA file, some at its edges, are read with
+// convert_tga_region_to_float_grayscale(): each must hold the whole image's pixels in that
+// window, and marching it in the whole image's frame must give the whole image's geometry there.
+//
+// Last, the query server is run on one end of a socket pair, with two generated TGA files:
+// load, stats, extract and unload are checked against a direct march, with requests for both
+// images in flight at once, and so are the errors for an unknown opcode and an unknown image id.
+//
+// Returns 0 if every check passes.
+int run_selftest(const unsigned long int iterations = 200, const unsigned long int seed = 1);
+
+// Times the reference kernel, as main() used to drive it, against the table-driven kernel
+// (both outputs, each output alone, and the statistics sink, which also sums lengths and areas)
+// and against march_rows(), on a uniform noise field and on a field of smooth blobs,
+// each size x size pixels. Prints the best of the repetitions for each.
+int run_benchmark(const unsigned short int size = 2000, const unsigned long int repetitions = 5, const unsigned long int seed = 1);
+
+#endif
@@ -0,0 +1,622 @@
+#include "server.h"
+#include "image.h"
+#include "march.h"
+
+#include <vector>
+using std::vector;
+
+#include <string>
+using std::string;
+
+#include <map>
+using std::map;
+
+#include <set>
+using std::set;
+
+#include <queue>
+using std::queue;
+
+#include <memory>
+using std::shared_ptr;
+
+#include <functional>
+using std::function;
+
+#include <thread>
+using std::thread;
+
+#include <mutex>
+using std::mutex;
+using std::lock_guard;
+using std::unique_lock;
+
+#include <condition_variable>
+using std::condition_variable;
+
+#include <chrono>
+using std::chrono::milliseconds;
+
+#include <iostream>
+using std::cerr;
+using std::endl;
+
+#include <cstring>
+#include <cerrno>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+
+#ifdef _WIN32
+
+int run_server(const char *const socket_path)
+{
+	cerr << "Server mode is not supported on this platform." << endl;
+	return 1;
+}
+
+int serve_stream(const int in_fd, const int out_fd)
+{
+	cerr << "Server mode is not supported on this platform." << endl;
+	return 1;
+}
+
+#else
+
+// Requests are small; anything larger than this is a protocol error.
+static const unsigned long long max_request_payload_size = 1 << 20;
+
+class server_image
+{
+public:
+	float_grayscale luma;
+	double grid_x_min;
+	double grid_y_max;
+	double step_size;
+};
+
+class worker_pool
+{
+public:
+	worker_pool(size_t num_threads)
+	{
+		stopping = false;
+
+		if(0 == num_threads)
+			num_threads = 1;
+
+		for(size_t i = 0; i < num_threads; i++)
+			threads.push_back(thread(&worker_pool::work, this));
+	}
+
+	~worker_pool(void)
+	{
+		{
+			lock_guard<mutex> lock(jobs_mutex);
+			stopping = true;
+		}
+
+		jobs_ready.notify_all();
+
+		for(size_t i = 0; i < threads.size(); i++)
+			threads[i].join();
+	}
+
+	void submit(const function<void(void)> &job)
+	{
+		{
+			lock_guard<mutex> lock(jobs_mutex);
+			jobs.push(job);
+		}
+
+		jobs_ready.notify_one();
+	}
+
+private:
+	vector<thread> threads;
+	queue<function<void(void)> > jobs;
+	mutex jobs_mutex;
+	condition_variable jobs_ready;
+	bool stopping;
+
+	void work(void)
+	{
+		for(;;)
+		{
+			function<void(void)> job;
+
+			{
+				unique_lock<mutex> lock(jobs_mutex);
+
+				while(false == stopping && jobs.empty())
+					jobs_ready.wait(lock);
+
+				if(jobs.empty())
+					return;
+
+				job = jobs.front();
+				jobs.pop();
+			}
+
+			job();
+		}
+	}
+};
+
+class connection
+{
+public:
+	int in_fd;
+	int out_fd;
+	mutex write_mutex;
+
+	mutex pending_mutex;
+	condition_variable pending_done;
+	size_t num_pending;
+};
+
+// Loaded images, shared by all connections.
+static mutex images_mutex;
+static map<unsigned int, shared_ptr<const server_image> > images;
+static unsigned int next_image_id = 1;
+
+
+static bool read_fully(const int fd, void *const buffer, const size_t num_bytes)
+{
+	char *p = static_cast<char *>(buffer);
+	size_t done = 0;
+
+	while(done < num_bytes)
+	{
+		ssize_t n = read(fd, p + done, num_bytes - done);
+
+		// Interrupted by a signal before anything was transferred.
+		if(-1 == n && EINTR == errno)
+			continue;
+
+		if(n <= 0)
+			return false;
+
+		done += static_cast<size_t>(n);
+	}
+
+	return true;
+}
+
+static bool write_fully(const int fd, const void *const buffer, const size_t num_bytes)
+{
+	const char *p = static_cast<const char *>(buffer);
+	size_t done = 0;
+
+	while(done < num_bytes)
+	{
+		ssize_t n = write(fd, p + done, num_bytes - done);
+
+		// Interrupted by a signal before anything was transferred.
+		if(-1 == n && EINTR == errno)
+			continue;
+
+		if(n <= 0)
+			return false;
+
+		done += static_cast<size_t>(n);
+	}
+
+	return true;
+}
+
+template<class T>
+static void append(vector<char> &buffer, const T &value)
+{
+	const char *p = reinterpret_cast<const char *>(&value);
+	buffer.insert(buffer.end(), p, p + sizeof(T));
+}
+
+static void send_response(connection &c, const unsigned long long request_id, const unsigned int status, const vector<char> &payload)
+{
+	message_header h;
+	h.magic = server_magic;
+	h.code = status;
+	h.request_id = request_id;
+	h.payload_size = payload.size();
+
+	lock_guard<mutex> lock(c.write_mutex);
+
+	write_fully(c.out_fd, &h, sizeof(h));
+
+	if(0 != payload.size())
+		write_fully(c.out_fd, &payload[0], payload.size());
+}
+
+static void send_error(connection &c, const unsigned long long request_id, const string &message)
+{
+	send_response(c, request_id, server_error, vector<char>(message.begin(), message.end()));
+}
+
+static shared_ptr<const server_image> find_image(const unsigned int id)
+{
+	lock_guard<mutex> lock(images_mutex);
+
+	map<unsigned int, shared_ptr<const server_image> >::const_iterator i = images.find(id);
+
+	if(images.end() == i)
+		return shared_ptr<const server_image>();
+
+	return i->second;
+}
+
+static void handle_load(connection &c, const unsigned long long request_id, const vector<char> &payload)
+{
+	double template_width = 0;
+
+	if(payload.size() <= sizeof(template_width))
+	{
+		send_error(c, request_id, "Load needs a template width and a file name.");
+		return;
+	}
+
+	memcpy(&template_width, &payload[0], sizeof(template_width));
+	string filename(payload.begin() + sizeof(template_width), payload.end());
+
+	if(!(0 < template_width))
+	{
+		send_error(c, request_id, "Template width must be > 0.");
+		return;
+	}
+
+	shared_ptr<server_image> image(new server_image);
+
+	// Same preprocessing as main(); the raw TGA is released when t goes out of scope.
+	{
+		tga t;
+
+		if(false == convert_tga_to_float_grayscale(filename.c_str(), t, image->luma, true, true, true))
+		{
+			send_error(c, request_id, "Failed to read TGA file: " + filename);
+			return;
+		}
+	}
+
+	if(image->luma.px < 3 || image->luma.py < 3)
+	{
+		send_error(c, request_id, "Template must be at least 3x3 pixels in size.");
+		return;
+	}
+
+	image->step_size = template_width/static_cast<double>(image->luma.px - 1);
+	image->grid_x_min = -template_width/2.0;
+	image->grid_y_max = image->step_size*(image->luma.py - 1)/2.0;
+
+	unsigned int id;
+
+	{
+		lock_guard<mutex> lock(images_mutex);
+		id = next_image_id++;
+		images[id] = image;
+	}
+
+	vector<char> response;
+	append(response, id);
+	append(response, static_cast<unsigned int>(image->luma.px));
+	append(response, static_cast<unsigned int>(image->luma.py));
+
+	send_response(c, request_id, server_ok, response);
+}
+
+static void handle_query(connection &c, const unsigned int opcode, const unsigned long long request_id, const vector<char> &payload)
+{
+	unsigned int id = 0;
+	double isovalue = 0;
+
+	if(payload.size() != 2*sizeof(unsigned int) + sizeof(double))
+	{
+		send_error(c, request_id, "Query needs an image id and an isovalue.");
+		return;
+	}
+
+	memcpy(&id, &payload[0], sizeof(id));
+	memcpy(&isovalue, &payload[2*sizeof(unsigned int)], sizeof(isovalue));
+
+	if(!(0 < isovalue && 1 > isovalue))
+	{
+		send_error(c, request_id, "Isovalue must be 0 < i < 1.");
+		return;
+	}
+
+	shared_ptr<const server_image> image = find_image(id);
+
+	if(0 == image.get())
+	{
+		send_error(c, request_id, "No such image.");
+		return;
+	}
+
+	size_t boundary_count = 0;
+	size_t interior_count = 0;
+	vector<char> response;
+
+	if(server_extract == opcode)
+	{
+		vector<line_segment> line_segments;
+		vector<triangle> triangles;
+
+		march_field(&image->luma.pixel_data[0], image->luma.px, image->luma.py, image->grid_x_min, image->grid_y_max, image->step_size, isovalue, line_segments, triangles, boundary_count, interior_count);
+
+		append(response, static_cast<unsigned long long>(line_segments.size()));
+		append(response, static_cast<unsigned long long>(triangles.size()));
+
+		response.reserve(response.size() + line_segments.size()*4*sizeof(double) + triangles.size()*6*sizeof(double));
+
+		for(size_t i = 0; i < line_segments.size(); i++)
+		{
+			for(size_t j = 0; j < 2; j++)
+			{
+				append(response, line_segments[i].vertex[j].x);
+				append(response, line_segments[i].vertex[j].y);
+			}
+		}
+
+		for(size_t i = 0; i < triangles.size(); i++)
+		{
+			for(size_t j = 0; j < 3; j++)
+			{
+				append(response, triangles[i].vertex[j].x);
+				append(response, triangles[i].vertex[j].y);
+			}
+		}
+	}
+	else
+	{
+		// The statistics are gathered as the geometry is generated, without storing it.
+		geometry_stats stats;
+		stats.begin(image->grid_x_min, image->grid_y_max);
+
+		march_field(&image->luma.pixel_data[0], image->luma.px, image->luma.py, image->grid_x_min, image->grid_y_max, image->step_size, isovalue, stats, boundary_count, interior_count);
+
+		append(response, static_cast<unsigned long long>(stats.num_line_segments));
+		append(response, static_cast<unsigned long long>(stats.num_triangles));
+		append(response, static_cast<unsigned long long>(boundary_count));
+		append(response, static_cast<unsigned long long>(interior_count));
+		append(response, stats.length);
+		append(response, stats.area);
+		append(response, stats.x_min);
+		append(response, stats.x_max);
+		append(response, stats.y_min);
+		append(response, stats.y_max);
+		append(response, static_cast<double>(box_counting_dimension(boundary_count, image->step_size)));
+	}
+
+	send_response(c, request_id, server_ok, response);
+}
+
+static void handle_unload(connection &c, const unsigned long long request_id, const vector<char> &payload)
+{
+	unsigned int id = 0;
+
+	if(payload.size() != sizeof(id))
+	{
+		send_error(c, request_id, "Unload needs an image id.");
+		return;
+	}
+
+	memcpy(&id, &payload[0], sizeof(id));
+
+	size_t num_erased;
+
+	{
+		lock_guard<mutex> lock(images_mutex);
+		num_erased = images.erase(id);
+	}
+
+	if(0 == num_erased)
+		send_error(c, request_id, "No such image.");
+	else
+		send_response(c, request_id, server_ok, vector<char>());
+}
+
+static void handle_request(const shared_ptr<connection> &c, const message_header &h, const vector<char> &payload)
+{
+	switch(h.code)
+	{
+		case server_load:
+			handle_load(*c, h.request_id, payload);
+			break;
+
+		case server_extract:
+		case server_stats:
+			handle_query(*c, h.code, h.request_id, payload);
+			break;
+
+		case server_unload:
+			handle_unload(*c, h.request_id, payload);
+			break;
+
+		default:
+			send_error(*c, h.request_id, "Unknown opcode.");
+			break;
+	}
+
+	lock_guard<mutex> lock(c->pending_mutex);
+
+	if(0 == --c->num_pending)
+		c->pending_done.notify_all();
+}
+
+// Read requests until the input ends, handing each to the worker pool,
+// then wait for the outstanding responses.
+static void serve_connection(const int in_fd, const int out_fd, worker_pool &pool)
+{
+	shared_ptr<connection> c(new connection);
+	c->in_fd = in_fd;
+	c->out_fd = out_fd;
+	c->num_pending = 0;
+
+	message_header h;
+
+	while(true == read_fully(in_fd, &h, sizeof(h)))
+	{
+		if(server_magic != h.magic || h.payload_size > max_request_payload_size)
+		{
+			send_error(*c, h.request_id, "Bad request header.");
+			break;
+		}
+
+		vector<char> payload(static_cast<size_t>(h.payload_size));
+
+		if(0 != payload.size() && false == read_fully(in_fd, &payload[0], payload.size()))
+			break;
+
+		{
+			lock_guard<mutex> lock(c->pending_mutex);
+			c->num_pending++;
+		}
+
+		pool.submit(std::bind(handle_request, c, h, payload));
+	}
+
+	unique_lock<mutex> lock(c->pending_mutex);
+
+	while(0 != c->num_pending)
+		c->pending_done.wait(lock);
+}
+
+// At least a few workers, so that a quick query is not stuck behind a long one on small machines.
+static size_t num_workers(void)
+{
+	size_t n = thread::hardware_concurrency();
+
+	if(n < 4)
+		n = 4;
+
+	return n;
+}
+
+int serve_stream(const int in_fd, const int out_fd)
+{
+	worker_pool workers(num_workers());
+	serve_connection(in_fd, out_fd, workers);
+
+	return 0;
+}
+
+int run_server(const char *const socket_path)
+{
+	// A client that goes away should not take the server with it.
+	signal(SIGPIPE, SIG_IGN);
+
+	if(0 == socket_path)
+		return serve_stream(0, 1);
+
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+
+	if(strlen(socket_path) >= sizeof(address.sun_path))
+	{
+		cerr << "Socket path is too long: " << socket_path << endl;
+		return 1;
+	}
+
+	strcpy(address.sun_path, socket_path);
+
+	// Replace a stale socket left by an earlier server, but nothing else.
+	struct stat existing;
+
+	if(0 == lstat(socket_path, &existing))
+	{
+		if(!S_ISSOCK(existing.st_mode))
+		{
+			cerr << "Socket path exists and is not a socket: " << socket_path << endl;
+			return 1;
+		}
+
+		unlink(socket_path);
+	}
+
+	int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if(-1 == listen_fd)
+	{
+		cerr << "Failed to create socket." << endl;
+		return 1;
+	}
+
+	if(0 != bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) || 0 != listen(listen_fd, 16))
+	{
+		cerr << "Failed to listen on socket: " << socket_path << endl;
+		close(listen_fd);
+		return 1;
+	}
+
+	cerr << "Listening on " << socket_path << endl;
+
+	// The connection threads use the workers, so the workers must outlive them:
+	// the open connections are tracked, and waited for before returning.
+	worker_pool workers(num_workers());
+
+	mutex clients_mutex;
+	condition_variable clients_done;
+	set<int> client_fds;
+
+	for(;;)
+	{
+		int client_fd = accept(listen_fd, 0, 0);
+
+		if(-1 == client_fd)
+		{
+			// Interrupted, or the client went away before it was accepted.
+			if(EINTR == errno || ECONNABORTED == errno)
+				continue;
+
+			// Out of descriptors: wait for some connections to close.
+			if(EMFILE == errno || ENFILE == errno)
+			{
+				cerr << "Out of file descriptors; retrying accept." << endl;
+				std::this_thread::sleep_for(milliseconds(100));
+				continue;
+			}
+
+			cerr << "Failed to accept on socket: " << socket_path << endl;
+			break;
+		}
+
+		{
+			lock_guard<mutex> lock(clients_mutex);
+			client_fds.insert(client_fd);
+		}
+
+		thread client([client_fd, &workers, &clients_mutex, &clients_done, &client_fds]()
+		{
+			serve_connection(client_fd, client_fd, workers);
+
+			// Closed under the lock, so that the descriptor is not reused while it may still be shut down below.
+			lock_guard<mutex> lock(clients_mutex);
+			close(client_fd);
+			client_fds.erase(client_fd);
+			clients_done.notify_all();
+		});
+
+		client.detach();
+	}
+
+	close(listen_fd);
+
+	// Stop reading from the open connections; each one finishes its outstanding requests and closes.
+	unique_lock<mutex> lock(clients_mutex);
+
+	for(set<int>::const_iterator i = client_fds.begin(); i != client_fds.end(); i++)
+		shutdown(*i, SHUT_RD);
+
+	while(false == client_fds.empty())
+		clients_done.wait(lock);
+
+	return 1;
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+// Long-lived query server. Images stay loaded between requests, and requests are
+// answered by a pool of worker threads, so requests for different images run concurrently.
+//
+// The server reads requests from stdin and writes responses to stdout, or, given a
+// socket path, listens on a local Unix domain socket and serves each connection the same way.
+// Responses may arrive in a different order than their requests; match them by request id.
+//
+// All integers and doubles are in the host's native byte order.
+//
+// Request:  uint32 magic, uint32 opcode, uint64 request id, uint64 payload size, payload.
+// Response: uint32 magic, uint32 status, uint64 request id, uint64 payload size, payload.
+// On error the status is non-zero and the payload is a message (not null-terminated).
+//
+// load     payload: double template width in metres, then the TGA path (not null-terminated).
+//          response: uint32 image id, uint32 px, uint32 py.
+// extract  payload: uint32 image id, uint32 padding (ignored), double isovalue.
+//          The padding keeps the isovalue 8-byte aligned, as in a C struct { uint32 id; double isovalue; }.
+//          response: uint64 line segment count, uint64 triangle count,
+//          then x0 y0 x1 y1 per line segment, then x0 y0 x1 y1 x2 y2 per triangle, all doubles.
+// stats    payload: as extract.
+//          response: uint64 line segment count, uint64 triangle count,
+//          uint64 boundary grid squares, uint64 interior grid squares,
+//          then doubles: length, area, x min, x max, y min, y max, box counting dimension.
+// unload   payload: uint32 image id. response: empty.
+const unsigned int server_magic = 0x3151534d; // "MSQ1"
+
+class message_header
+{
+public:
+	unsigned int magic;
+	unsigned int code; // Opcode in requests, status in responses.
+	unsigned long long request_id;
+	unsigned long long payload_size;
+};
+
+enum server_opcode
+{
+	server_load = 1,
+	server_extract = 2,
+	server_stats = 3,
+	server_unload = 4
+};
+
+enum server_status
+{
+	server_ok = 0,
+	server_error = 1
+};
+
+// Serve on stdin/stdout if socket_path is null. Returns when input ends (stdin),
+// or on a socket error, once the open connections have finished.
+// An existing file at socket_path is replaced only if it is a socket.
+int run_server(const char *const socket_path = 0);
+
+// Serve one connection on the given descriptors, e.g. one end of a socketpair(),
+// until its input ends. Returns once every response has been written.
+int serve_stream(const int in_fd, const int out_fd);
+
+#endif
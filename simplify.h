@@ -0,0 +1,462 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <vector>
+using std::vector;
+
+#include <deque>
+using std::deque;
+
+#include <map>
+using std::map;
+
+#include <utility>
+using std::pair;
+
+#include <cmath>
+
+#include "primitives.h"
+
+
+// Stitches marching squares line segments into contours as the march proceeds,
+// and simplifies each contour end as it grows, using a sleeve (wedge) test
+// so that no skipped vertex strays more than half the tolerance from its replacement
+// line segment. Only the simplified vertices of contours that can still grow
+// are held in memory; a contour is written out as soon as it closes, or as soon
+// as neither of its ends lies on the bottom edge of the most recently completed row.
+//
+// Joining two contours ends the sleeves at the join, and a contour that grows against
+// the march order (e.g. a straight edge sloping down to the left) is joined once per row.
+// So when a contour is written out, its held vertices are simplified once more, by
+// Douglas-Peucker with the other half of the tolerance. Distance to a line segment is
+// convex, so every original vertex stays within the whole tolerance of the output.
+//
+// Segment endpoints on a shared grid edge are bitwise identical in neighbouring
+// grid squares (both interpolate from the inside corner to the outside corner),
+// so the ends are matched by exact vertex equality.
+class contour_simplifier
+{
+public:
+	contour_simplifier(const double src_tolerance = 0)
+	{
+		tolerance = src_tolerance;
+	}
+
+	// Add one line segment produced by the march.
+	// Contours that close are written to output.
+	void add(const line_segment &ls, vector<line_segment> &output)
+	{
+		const vertex_2 &p = ls.vertex[0];
+		const vertex_2 &q = ls.vertex[1];
+
+		// Zero-length segments (corner values equal to the isovalue) add nothing.
+		if(p == q)
+			return;
+
+		map<vertex_2, pair<size_t, int> >::iterator pi = open_ends.find(p);
+		map<vertex_2, pair<size_t, int> >::iterator qi = open_ends.find(q);
+
+		if(open_ends.end() == pi && open_ends.end() == qi)
+		{
+			size_t c = new_contour(p);
+			extend(c, 1, q);
+
+			open_ends[p] = pair<size_t, int>(c, 0);
+			open_ends[q] = pair<size_t, int>(c, 1);
+		}
+		else if(open_ends.end() == qi || open_ends.end() == pi)
+		{
+			// Exactly one end matches; grow that contour by the other vertex.
+			map<vertex_2, pair<size_t, int> >::iterator found = (open_ends.end() == qi) ? pi : qi;
+			const vertex_2 &other = (open_ends.end() == qi) ? q : p;
+
+			pair<size_t, int> e = found->second;
+			open_ends.erase(found);
+
+			extend(e.first, e.second, other);
+			open_ends[other] = e;
+		}
+		else
+		{
+			pair<size_t, int> ep = pi->second;
+			pair<size_t, int> eq = qi->second;
+
+			open_ends.erase(pi);
+			open_ends.erase(qi);
+
+			if(ep.first == eq.first)
+			{
+				// The segment closes a loop.
+				extend(ep.first, ep.second, q);
+				finish(ep.first, output);
+			}
+			else
+			{
+				join(ep, eq, output);
+			}
+		}
+	}
+
+	// Call once a row of grid squares is complete, where bottom_y is the y coordinate
+	// of the bottom edge of that row. Contour ends that do not lie on this edge can
+	// never be reached by the remaining rows, so contours with no such ends are written
+	// to output.
+	void end_row(const double bottom_y, vector<line_segment> &output)
+	{
+		map<vertex_2, pair<size_t, int> >::iterator i = open_ends.begin();
+
+		while(open_ends.end() != i)
+		{
+			if(i->first.y == bottom_y)
+			{
+				i++;
+				continue;
+			}
+
+			size_t c = i->second.first;
+			open_ends.erase(i++);
+
+			if(0 == --contours[c].num_open_ends)
+				finish(c, output);
+		}
+	}
+
+	// Write out all remaining contours.
+	void flush(vector<line_segment> &output)
+	{
+		for(map<vertex_2, pair<size_t, int> >::iterator i = open_ends.begin(); i != open_ends.end(); i++)
+		{
+			size_t c = i->second.first;
+
+			if(0 == --contours[c].num_open_ends)
+				finish(c, output);
+		}
+
+		open_ends.clear();
+	}
+
+private:
+	// One growing end of a contour. The anchor is the last vertex that was kept.
+	// The floater is the most recent vertex; it replaces all vertices since the anchor,
+	// for as long as their directions from the anchor fit in the wedge.
+	class contour_end
+	{
+	public:
+		vertex_2 anchor;
+		vertex_2 floater;
+		bool has_floater;
+		double floater_distance;
+		double reference_angle;
+		double wedge_min;
+		double wedge_max;
+	};
+
+	class contour
+	{
+	public:
+		// Kept vertices, from end 0 (front) to end 1 (back).
+		deque<vertex_2> points;
+		contour_end ends[2];
+		int num_open_ends;
+	};
+
+	double tolerance;
+	vector<contour> contours;
+	vector<size_t> free_contours;
+	map<vertex_2, pair<size_t, int> > open_ends;
+
+	size_t new_contour(const vertex_2 &p)
+	{
+		size_t c;
+
+		if(0 != free_contours.size())
+		{
+			c = free_contours.back();
+			free_contours.pop_back();
+		}
+		else
+		{
+			c = contours.size();
+			contours.push_back(contour());
+		}
+
+		contours[c].points.clear();
+		contours[c].points.push_back(p);
+		contours[c].num_open_ends = 2;
+
+		for(int i = 0; i < 2; i++)
+		{
+			contours[c].ends[i].anchor = p;
+			contours[c].ends[i].has_floater = false;
+		}
+
+		return c;
+	}
+
+	// Half-width of the cone of directions from the anchor that pass within
+	// half the tolerance of a vertex at distance d.
+	inline double cone(const double d) const
+	{
+		const double sleeve_tolerance = tolerance/2.0;
+
+		if(d <= sleeve_tolerance)
+			return 4.0*atan(1.0); // Any direction.
+
+		return asin(sleeve_tolerance/d);
+	}
+
+	void start_floater(contour_end &e, const vertex_2 &p)
+	{
+		double dx = p.x - e.anchor.x;
+		double dy = p.y - e.anchor.y;
+
+		e.floater = p;
+		e.has_floater = true;
+		e.floater_distance = sqrt(dx*dx + dy*dy);
+		e.reference_angle = atan2(dy, dx);
+		e.wedge_max = cone(e.floater_distance);
+		e.wedge_min = -e.wedge_max;
+	}
+
+	void commit_floater(contour &c, const int end)
+	{
+		contour_end &e = c.ends[end];
+
+		if(false == e.has_floater)
+			return;
+
+		if(0 == end)
+			c.points.push_front(e.floater);
+		else
+			c.points.push_back(e.floater);
+
+		e.anchor = e.floater;
+		e.has_floater = false;
+	}
+
+	void extend(const size_t c, const int end, const vertex_2 &p)
+	{
+		contour_end &e = contours[c].ends[end];
+
+		if(false == e.has_floater)
+		{
+			start_floater(e, p);
+			return;
+		}
+
+		double dx = p.x - e.anchor.x;
+		double dy = p.y - e.anchor.y;
+		double d = sqrt(dx*dx + dy*dy);
+
+		const double pi = 4.0*atan(1.0);
+		double angle = atan2(dy, dx) - e.reference_angle;
+
+		if(angle > pi)
+			angle -= 2.0*pi;
+		else if(angle < -pi)
+			angle += 2.0*pi;
+
+		// Moving back towards the anchor, or leaving the wedge, ends the run.
+		if(d < e.floater_distance || angle < e.wedge_min || angle > e.wedge_max)
+		{
+			commit_floater(contours[c], end);
+			start_floater(e, p);
+			return;
+		}
+
+		double half_width = cone(d);
+
+		if(angle - half_width > e.wedge_min)
+			e.wedge_min = angle - half_width;
+
+		if(angle + half_width < e.wedge_max)
+			e.wedge_max = angle + half_width;
+
+		e.floater = p;
+		e.floater_distance = d;
+	}
+
+	// Join two different contours whose ends meet the two vertices of one segment.
+	// If neither contour has another open end, the joined contour is complete.
+	void join(pair<size_t, int> a, pair<size_t, int> b, vector<line_segment> &output)
+	{
+		// Move the shorter contour's vertices into the longer one.
+		if(contours[a.first].points.size() < contours[b.first].points.size())
+		{
+			pair<size_t, int> temp = a;
+			a = b;
+			b = temp;
+		}
+
+		contour &ca = contours[a.first];
+		contour &cb = contours[b.first];
+
+		commit_floater(ca, a.second);
+		commit_floater(cb, b.second);
+
+		// Walk b from the joined end towards its other end.
+		if(0 == b.second)
+		{
+			for(deque<vertex_2>::const_iterator i = cb.points.begin(); i != cb.points.end(); i++)
+			{
+				if(0 == a.second)
+					ca.points.push_front(*i);
+				else
+					ca.points.push_back(*i);
+			}
+		}
+		else
+		{
+			for(deque<vertex_2>::const_reverse_iterator i = cb.points.rbegin(); i != cb.points.rend(); i++)
+			{
+				if(0 == a.second)
+					ca.points.push_front(*i);
+				else
+					ca.points.push_back(*i);
+			}
+		}
+
+		// b's far end becomes a's joined end.
+		ca.ends[a.second] = cb.ends[1 - b.second];
+		ca.num_open_ends = ca.num_open_ends - 1 + cb.num_open_ends - 1;
+
+		const contour_end &far_end = ca.ends[a.second];
+		const vertex_2 &far_tip = far_end.has_floater ? far_end.floater : far_end.anchor;
+
+		map<vertex_2, pair<size_t, int> >::iterator i = open_ends.find(far_tip);
+
+		if(open_ends.end() != i && i->second.first == b.first && i->second.second == 1 - b.second)
+			i->second = a;
+
+		cb.points.clear();
+		free_contours.push_back(b.first);
+
+		if(0 == ca.num_open_ends)
+			finish(a.first, output);
+	}
+
+	static double distance_to_segment(const vertex_2 &p, const vertex_2 &a, const vertex_2 &b)
+	{
+		const double dx = b.x - a.x;
+		const double dy = b.y - a.y;
+		const double length_squared = dx*dx + dy*dy;
+
+		double t = 0;
+
+		if(0 != length_squared)
+			t = ((p.x - a.x)*dx + (p.y - a.y)*dy)/length_squared;
+
+		if(t < 0)
+			t = 0;
+		else if(t > 1)
+			t = 1;
+
+		const double ex = a.x + t*dx - p.x;
+		const double ey = a.y + t*dy - p.y;
+
+		return sqrt(ex*ex + ey*ey);
+	}
+
+	// Douglas-Peucker on points[first] ... points[last], with both ends kept:
+	// marks the vertices to keep.
+	void reduce(const deque<vertex_2> &points, const size_t first, const size_t last, vector<char> &keep)
+	{
+		const double reduce_tolerance = tolerance/2.0;
+
+		vector<pair<size_t, size_t> > spans;
+		spans.push_back(pair<size_t, size_t>(first, last));
+
+		while(0 != spans.size())
+		{
+			const size_t a = spans.back().first;
+			const size_t b = spans.back().second;
+			spans.pop_back();
+
+			size_t farthest = a;
+			double farthest_distance = reduce_tolerance;
+
+			for(size_t i = a + 1; i < b; i++)
+			{
+				const double d = distance_to_segment(points[i], points[a], points[b]);
+
+				if(d > farthest_distance)
+				{
+					farthest = i;
+					farthest_distance = d;
+				}
+			}
+
+			if(a == farthest)
+				continue;
+
+			keep[farthest] = 1;
+			spans.push_back(pair<size_t, size_t>(a, farthest));
+			spans.push_back(pair<size_t, size_t>(farthest, b));
+		}
+	}
+
+	void finish(const size_t c, vector<line_segment> &output)
+	{
+		contour &ct = contours[c];
+
+		commit_floater(ct, 0);
+		commit_floater(ct, 1);
+
+		const size_t n = ct.points.size();
+
+		if(2 <= n)
+		{
+			vector<char> keep(n, 0);
+			keep[0] = 1;
+			keep[n - 1] = 1;
+
+			// A closed contour is split at its vertex farthest from the start,
+			// so that both halves have distinct ends.
+			size_t split = n - 1;
+
+			if(3 < n && ct.points[0] == ct.points[n - 1])
+			{
+				double farthest_distance = -1;
+
+				for(size_t i = 1; i < n - 1; i++)
+				{
+					const double dx = ct.points[i].x - ct.points[0].x;
+					const double dy = ct.points[i].y - ct.points[0].y;
+					const double d = dx*dx + dy*dy;
+
+					if(d > farthest_distance)
+					{
+						split = i;
+						farthest_distance = d;
+					}
+				}
+
+				keep[split] = 1;
+			}
+
+			reduce(ct.points, 0, split, keep);
+
+			if(n - 1 != split)
+				reduce(ct.points, split, n - 1, keep);
+
+			line_segment ls;
+			ls.vertex[0] = ct.points[0];
+
+			for(size_t i = 1; i < n; i++)
+			{
+				if(0 == keep[i])
+					continue;
+
+				ls.vertex[1] = ct.points[i];
+				output.push_back(ls);
+				ls.vertex[0] = ct.points[i];
+			}
+		}
+
+		ct.points.clear();
+		ct.num_open_ends = 0;
+		free_contours.push_back(c);
+	}
+};
+
+#endif
@@ -0,0 +1,217 @@
+#ifndef SINKS_H
+#define SINKS_H
+
+#include <vector>
+using std::vector;
+
+#include <fstream>
+using std::ofstream;
+
+#include <ios>
+using std::ios;
+
+#include <cstddef>
+
+#include "primitives.h"
+
+
+// Output sinks for grid_square::generate(). Each line segment and triangle is handed
+// to the sink's add() as it is generated. A sink says which of the two it wants, and
+// the kernel compiles out whatever it does not want.
+//
+// A sink provides:
+// static const bool wants_line_segments, wants_triangles;
+// void add(const line_segment &ls);
+// void add(const triangle &t);
+
+// Wants nothing; for timing the classification alone.
+class discard_sink
+{
+public:
+	static const bool wants_line_segments = false;
+	static const bool wants_triangles = false;
+
+	inline void add(const line_segment &) {}
+	inline void add(const triangle &) {}
+};
+
+class count_sink
+{
+public:
+	static const bool wants_line_segments = true;
+	static const bool wants_triangles = true;
+
+	size_t num_line_segments;
+	size_t num_triangles;
+
+	count_sink(void)
+	{
+		num_line_segments = 0;
+		num_triangles = 0;
+	}
+
+	inline void add(const line_segment &) { num_line_segments++; }
+	inline void add(const triangle &) { num_triangles++; }
+};
+
+// Appends to vectors. Either output can be turned off, in which case its vector is left alone.
+template<bool want_line_segments = true, bool want_triangles = true>
+class vector_sink
+{
+public:
+	static const bool wants_line_segments = want_line_segments;
+	static const bool wants_triangles = want_triangles;
+
+	vector<line_segment> &line_segments;
+	vector<triangle> &triangles;
+
+	vector_sink(vector<line_segment> &src_line_segments, vector<triangle> &src_triangles) : line_segments(src_line_segments), triangles(src_triangles) {}
+
+	inline void add(const line_segment &ls) { line_segments.push_back(ls); }
+	inline void add(const triangle &t) { triangles.push_back(t); }
+};
+
+// Totals over a set of geometric primitives.
+class geometry_stats
+{
+public:
+	static const bool wants_line_segments = true;
+	static const bool wants_triangles = true;
+
+	size_t num_line_segments;
+	size_t num_triangles;
+	double length;
+	double area;
+	double x_min;
+	double x_max;
+	double y_min;
+	double y_max;
+
+	// The bounds start inverted over the grid, so that they stay inverted if there are no line segments.
+	void begin(const double grid_x_min, const double grid_y_max)
+	{
+		num_line_segments = 0;
+		num_triangles = 0;
+		length = 0;
+		area = 0;
+
+		x_max = grid_x_min;
+		x_min = -grid_x_min;
+		y_max = -grid_y_max;
+		y_min = grid_y_max;
+	}
+
+	inline void add(const line_segment &ls)
+	{
+		num_line_segments++;
+		length += ls.length();
+
+		for(size_t j = 0; j < 2; j++)
+		{
+			const vertex_2 &v = ls.vertex[j];
+
+			if(v.x > x_max)
+				x_max = v.x;
+
+			if(v.x < x_min)
+				x_min = v.x;
+
+			if(v.y > y_max)
+				y_max = v.y;
+
+			if(v.y < y_min)
+				y_min = v.y;
+		}
+	}
+
+	inline void add(const triangle &t)
+	{
+		num_triangles++;
+		area += t.area();
+	}
+
+	void gather(const vector<line_segment> &line_segments, const vector<triangle> &triangles, const double grid_x_min, const double grid_y_max)
+	{
+		begin(grid_x_min, grid_y_max);
+
+		for(size_t i = 0; i < line_segments.size(); i++)
+			add(line_segments[i]);
+
+		for(size_t i = 0; i < triangles.size(); i++)
+			add(triangles[i]);
+	}
+
+	double length_per_area(void) const
+	{
+		if(0 != area)
+			return length/area;
+
+		return 0;
+	}
+};
+
+// Streams the geometry to a text file as it is generated, one primitive per line:
+// l x0 y0 x1 y1
+// t x0 y0 x1 y1 x2 y2
+class file_sink
+{
+public:
+	static const bool wants_line_segments = true;
+	static const bool wants_triangles = true;
+
+	ofstream out;
+
+	file_sink(const char *const filename) : out(filename, ios::binary)
+	{
+		out.precision(17);
+	}
+
+	bool is_open(void) const
+	{
+		return out.is_open();
+	}
+
+	inline void add(const line_segment &ls)
+	{
+		out << "l " << ls.vertex[0].x << ' ' << ls.vertex[0].y << ' ' << ls.vertex[1].x << ' ' << ls.vertex[1].y << '\n';
+	}
+
+	inline void add(const triangle &t)
+	{
+		out << "t " << t.vertex[0].x << ' ' << t.vertex[0].y << ' ' << t.vertex[1].x << ' ' << t.vertex[1].y << ' ' << t.vertex[2].x << ' ' << t.vertex[2].y << '\n';
+	}
+};
+
+// Hands each primitive to two sinks, e.g. to write geometry and gather its statistics in one pass.
+template<class first_sink, class second_sink>
+class tee_sink
+{
+public:
+	static const bool wants_line_segments = first_sink::wants_line_segments || second_sink::wants_line_segments;
+	static const bool wants_triangles = first_sink::wants_triangles || second_sink::wants_triangles;
+
+	first_sink &first;
+	second_sink &second;
+
+	tee_sink(first_sink &src_first, second_sink &src_second) : first(src_first), second(src_second) {}
+
+	inline void add(const line_segment &ls)
+	{
+		if(true == first_sink::wants_line_segments)
+			first.add(ls);
+
+		if(true == second_sink::wants_line_segments)
+			second.add(ls);
+	}
+
+	inline void add(const triangle &t)
+	{
+		if(true == first_sink::wants_triangles)
+			first.add(t);
+
+		if(true == second_sink::wants_triangles)
+			second.add(t);
+	}
+};
+
+#endif
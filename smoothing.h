@@ -0,0 +1,202 @@
+#ifndef SMOOTHING_H
+#define SMOOTHING_H
+
+#include <vector>
+using std::vector;
+
+#include <cmath>
+#include <cstddef>
+
+
+// Supplies the rows of a float grayscale image to the march, optionally
+// smoothed by a separable box or Gaussian filter.
+//
+// The filter is applied on demand, just ahead of the march: each input row is
+// blurred horizontally into a ring of 2r + 1 rows, and each output row is then
+// blurred vertically from that ring. Only the two output rows currently under
+// the march are kept, so the blurred image is never stored as a whole.
+// Rows must be requested in increasing order (row(y) then row(y + 1), and so on).
+// Image edges are extended by repeating the edge pixels.
+class smoothed_rows
+{
+public:
+	enum filter_type { no_filter, box_filter, gaussian_filter };
+
+	// For the box filter, size is the radius in pixels.
+	// For the Gaussian filter, size is the standard deviation in pixels, and
+	// the radius is three standard deviations.
+	smoothed_rows(const float *const src_pixels, const unsigned short int src_px, const unsigned short int src_py, const filter_type src_filter = no_filter, const double size = 0, const bool src_make_black_border = false)
+	{
+		pixels = src_pixels;
+		px = src_px;
+		py = src_py;
+		filter = src_filter;
+		make_black_border = src_make_black_border;
+		radius = 0;
+		next_output_row = 0;
+
+		if(gaussian_filter == filter)
+			radius = static_cast<size_t>(ceil(3.0*size));
+		else if(box_filter == filter)
+			radius = static_cast<size_t>(size);
+
+		if(0 == radius)
+		{
+			filter = no_filter;
+			return;
+		}
+
+		weights.resize(2*radius + 1);
+
+		float weight_sum = 0;
+
+		for(size_t i = 0; i < weights.size(); i++)
+		{
+			if(gaussian_filter == filter)
+			{
+				double d = static_cast<double>(i) - static_cast<double>(radius);
+				weights[i] = static_cast<float>(exp(-d*d/(2.0*size*size)));
+			}
+			else
+			{
+				weights[i] = 1.0f;
+			}
+
+			weight_sum += weights[i];
+		}
+
+		for(size_t i = 0; i < weights.size(); i++)
+			weights[i] /= weight_sum;
+
+		horizontal_rows.resize(weights.size()*px);
+		output_rows.resize(2*px);
+		next_horizontal_row = 0;
+	}
+
+	const float *row(const size_t y)
+	{
+		if(no_filter == filter)
+			return pixels + y*px;
+
+		while(next_output_row <= y)
+			compute_output_row(next_output_row++);
+
+		return &output_rows[(y % 2)*px];
+	}
+
+private:
+	const float *pixels;
+	unsigned short int px;
+	unsigned short int py;
+	filter_type filter;
+	bool make_black_border;
+	size_t radius;
+
+	vector<float> weights;
+	vector<float> horizontal_rows; // Ring of 2r + 1 horizontally blurred rows.
+	vector<float> output_rows; // The two most recent output rows.
+	size_t next_horizontal_row;
+	size_t next_output_row;
+
+	inline size_t clamp_row(const ptrdiff_t y) const
+	{
+		if(y < 0)
+			return 0;
+
+		if(y >= static_cast<ptrdiff_t>(py))
+			return py - 1;
+
+		return static_cast<size_t>(y);
+	}
+
+	void compute_horizontal_row(const size_t y)
+	{
+		const float *in = pixels + y*px;
+		float *out = &horizontal_rows[(y % weights.size())*px];
+		const ptrdiff_t r = static_cast<ptrdiff_t>(radius);
+		const ptrdiff_t w = static_cast<ptrdiff_t>(px);
+
+		// Interior: no clamping, contiguous loops that the compiler can vectorize.
+		ptrdiff_t interior_begin = r;
+		ptrdiff_t interior_end = w - r;
+
+		if(interior_end < interior_begin)
+			interior_end = interior_begin = 0;
+
+		for(ptrdiff_t x = interior_begin; x < interior_end; x++)
+			out[x] = 0;
+
+		for(ptrdiff_t k = 0; k <= 2*r; k++)
+		{
+			const float wk = weights[k];
+			const float *src = in + k - r;
+
+			for(ptrdiff_t x = interior_begin; x < interior_end; x++)
+				out[x] += wk*src[x];
+		}
+
+		// Edges: clamp to the first and last pixel.
+		for(ptrdiff_t x = 0; x < w; x++)
+		{
+			if(x >= interior_begin && x < interior_end)
+				continue;
+
+			float sum = 0;
+
+			for(ptrdiff_t k = 0; k <= 2*r; k++)
+			{
+				ptrdiff_t sx = x + k - r;
+
+				if(sx < 0)
+					sx = 0;
+				else if(sx >= w)
+					sx = w - 1;
+
+				sum += weights[k]*in[sx];
+			}
+
+			out[x] = sum;
+		}
+	}
+
+	void compute_output_row(const size_t y)
+	{
+		// Make sure the horizontal rows y - r ... y + r are in the ring.
+		size_t last_needed = clamp_row(static_cast<ptrdiff_t>(y + radius));
+
+		while(next_horizontal_row <= last_needed)
+			compute_horizontal_row(next_horizontal_row++);
+
+		float *out = &output_rows[(y % 2)*px];
+
+		for(size_t x = 0; x < px; x++)
+			out[x] = 0;
+
+		for(size_t k = 0; k < weights.size(); k++)
+		{
+			const float wk = weights[k];
+			size_t sy = clamp_row(static_cast<ptrdiff_t>(y + k) - static_cast<ptrdiff_t>(radius));
+			const float *src = &horizontal_rows[(sy % weights.size())*px];
+
+			for(size_t x = 0; x < px; x++)
+				out[x] += wk*src[x];
+		}
+
+		// Keep the contours closed at the image edges, as the unsmoothed image does.
+		if(true == make_black_border)
+		{
+			if(0 == y || static_cast<size_t>(py) - 1 == y)
+			{
+				for(size_t x = 0; x < px; x++)
+					out[x] = 0;
+			}
+			else
+			{
+				out[0] = 0;
+				out[px - 1] = 0;
+			}
+		}
+	}
+};
+
+#endif